@@ -3,6 +3,7 @@
 
 #include "../src/datastructures.h"
 #include "../src/common.h"
+#include "../src/io/writer.h"
 
 #include <algorithm>
 #include <iomanip>
@@ -13,8 +14,10 @@
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <utility>
 #include <vector>
 #include <sqlite_orm/sqlite_orm.h>
+#include <xpu/host.h>
 
 namespace experimental {
 
@@ -24,6 +27,7 @@ namespace experimental {
         int n;
         std::string device;
         std::string timestamp;
+        float loadMs;
     };
 
     struct BenchmarkEntry {
@@ -42,11 +46,36 @@ namespace experimental {
         int itemsPerThread;
     };
 
+    /// <summary>
+    /// Runs of one kernel that belong to one benchmark: get_timing<Kernel>() holds the runs of every benchmark that
+    /// launches the kernel. start() in setup() and stop() in teardown() mark this benchmark's range.
+    /// </summary>
+    template<typename Kernel>
+    class kernel_timings {
+        size_t begin_ = 0;
+        size_t end_ = ~size_t(0);
+
+    public:
+        void start() {
+            begin_ = xpu::get_timing<Kernel>().size();
+            end_ = ~size_t(0);
+        }
+
+        void stop() { end_ = xpu::get_timing<Kernel>().size(); }
+
+        std::vector<float> get() const {
+            const std::vector<float> t = xpu::get_timing<Kernel>();
+            return std::vector<float>(t.begin() + std::min(begin_, t.size()), t.begin() + std::min(end_, t.size()));
+        }
+    };
+
     class benchmark {
 
     public:
         bool write_;
         bool check_;
+        OutputFormat format_ = OutputFormat::csv;
+        unsigned int writeThreads_ = default_thread_count();
         std::vector<float> timings_;
 
         benchmark(const bool in_write = false, const bool in_check = true) : write_(in_write), check_(in_check) {}
@@ -62,7 +91,27 @@ namespace experimental {
 
         virtual size_t bytes() const { return 0; }
 
-        virtual std::vector<float> timings() { return timings_; }
+        // Bucket layout of the output, written as index table next to the binary output (if known).
+        virtual const bucket_t* buckets() const { return nullptr; }
+
+        // Per run. With a breakdown(), the sum of its parts.
+        virtual std::vector<float> timings() {
+            const auto parts = breakdown();
+            if (parts.empty()) { return timings_; }
+
+            std::vector<float> sum;
+            for (const auto& part : parts) { add_timings(sum, part.second); }
+            return sum;
+        }
+
+        // Optional split of timings() into named parts (per run, like timings()), printed below the total.
+        virtual std::vector<std::pair<std::string, std::vector<float>>> breakdown() { return {}; }
+
+        // Adds t to sum run by run, sum grows to the longer of the two.
+        static void add_timings(std::vector<float>& sum, const std::vector<float>& t) {
+            if (sum.size() < t.size()) { sum.resize(t.size(), 0); }
+            for (size_t i = 0; i < t.size(); i++) { sum[i] += t[i]; }
+        }
 
         virtual std::string filename() {
             std::string name(info().name);
@@ -83,23 +132,18 @@ namespace experimental {
 
         virtual void write() {
             create_dir("output");
-            digi_t* sorted = output();
+            const digi_t* sorted = output();
 
             // +------------------------------------------------------------------------------+
             // |                               Sorted output                                  |
             // +------------------------------------------------------------------------------+
-            std::ofstream file;
-            file.open("output/" + filename() + ".csv", std::ios::out | std::ios::trunc);
-            // file << "index," + digi_t::csv_headers() + "\n";
-            file << digi_t::csv_headers() + "\n";
-
-            for (int i = 0; i < size(); i++) {
-                // file << i << "," << sorted[i].to_csv() << "\n";
-                file << sorted[i].to_csv() << "\n";
+            if (format_ == OutputFormat::binary) {
+                writeSortedBinary("output/" + filename() + ".bin", sorted, size(), buckets(), writeThreads_);
+                std::cout << "Wrote binary file ...\n";
+            } else {
+                writeSortedCsv("output/" + filename() + ".csv", sorted, size(), writeThreads_);
+                std::cout << "Wrote CSV file ...\n";
             }
-
-            file.close();
-            std::cout << "Wrote CSV file ...\n";
         }
 
         virtual void check() {
@@ -145,7 +189,23 @@ namespace experimental {
     public:
         benchmark_runner(const std::string in_subfolder, const std::string in_input_file) : subfolder(in_subfolder), input_file(in_input_file) {}
 
-        void add(benchmark* b) { benchmarks.emplace_back(b); }
+        void add(benchmark* b) {
+            benchmarks.emplace_back(b);
+            columns.emplace_back(b->info().name, b);
+        }
+
+        // A benchmark not run with this input or these options: it keeps its column in the CSV files with an empty
+        // value, so rows of different runs into the same folder line up with the header.
+        void skip(const std::string& name) { columns.emplace_back(name, nullptr); }
+
+        // Time it took to get the input into memory, reported separately from the sort timings.
+        void set_load_time(const float ms) { load_ms = ms; }
+
+        // Format (and threads) of the sorted output written with -w/-W.
+        void set_output_format(const OutputFormat format, const unsigned int threads) {
+            output_format = format;
+            write_threads = threads;
+        }
 
         inline auto init_storage(const std::string& path) {
             using namespace sqlite_orm;
@@ -155,7 +215,8 @@ namespace experimental {
                                         make_column("File", &BenchmarkRun::file),
                                         make_column("N", &BenchmarkRun::n),
                                         make_column("Device", &BenchmarkRun::device),
-                                        make_column("Timestamp", &BenchmarkRun::timestamp)),
+                                        make_column("Timestamp", &BenchmarkRun::timestamp),
+                                        make_column("LoadMs", &BenchmarkRun::loadMs, default_value(0.0f))),
 
                                 make_table("BenchmarkResults",
                                         make_column("BenchmarkEntryId", &BenchmarkEntry::benchmarkEntryId, primary_key()),
@@ -179,8 +240,26 @@ namespace experimental {
 
             const std::string filename = (subfolder != "") ? subfolder + "/benchmark_results.csv" : "benchmark_results.csv";
             const std::string tp_filename = (subfolder != "") ? subfolder + "/benchmark_tp.csv" : "benchmark_tp.csv";
+            const std::string load_filename = (subfolder != "") ? subfolder + "/benchmark_load.csv" : "benchmark_load.csv";
 
             const bool exists = file_exists(filename);
+            const bool load_exists = file_exists(load_filename);
+
+            // Rows are positional: appended only under the same columns.
+            std::string header = "\"n\"";
+            for (const auto& column : columns) {
+                header += ",\"" + column.first + "\"";
+            }
+            bool append = true;
+            if (exists) {
+                std::ifstream previous(filename);
+                std::string previousHeader;
+                std::getline(previous, previousHeader);
+                if (previousHeader != header) {
+                    std::cout << "Warning: " << filename << " has other benchmark columns, results are not appended to the CSV files.\n";
+                    append = false;
+                }
+            }
 
             std::ofstream output;
             output.open(filename, std::ios::out | std::ios_base::app);
@@ -188,18 +267,15 @@ namespace experimental {
             std::ofstream tp;
             tp.open(tp_filename, std::ios::out | std::ios_base::app);
 
-            // Header
+            std::ofstream load;
+            load.open(load_filename, std::ios::out | std::ios_base::app);
+            if (!load_exists) { load << "\"n\",\"LoadMs\"\n"; }
 
-            // n col.
-            if (!exists) { output << "\"n\""; tp << "\"n\""; }
+            // Header: n, then the benchmark names as cols.
+            if (!exists) { output << header << "\n"; tp << header << "\n"; }
             std::cout << "Writing benchmark results ..\n";
 
-            // Benchmark names as cols.
             for (auto& b: benchmarks) {
-                if (!exists) {
-                    output << ",\"" << b.get()->info().name << "\"";
-                    tp << ",\"" << b.get()->info().name << "\"";
-                }
                 run_benchmark(b.get(), n);
             }
 
@@ -207,7 +283,7 @@ namespace experimental {
             // |  Benchmark complete. Add to database.                                        |
             // +------------------------------------------------------------------------------+
             storage.transaction([&] () mutable {    
-                BenchmarkRun run{-1, get_filename(input_file), (int)benchmarks[0].get()->size(), get_device(), storage.current_timestamp()};
+                BenchmarkRun run{-1, get_filename(input_file), (int)benchmarks[0].get()->size(), get_device(), storage.current_timestamp(), load_ms};
                 run.benchmarkId = storage.insert(run);
                 for (auto& b: benchmarks) {
                             const BenchmarkInfo info = b.get()->info();
@@ -225,8 +301,9 @@ namespace experimental {
             // +------------------------------------------------------------------------------+
             // |  Print output and write to CSV.                                              |
             // +------------------------------------------------------------------------------+
-            // Line end.
-            if (!exists) { output << "\n"; tp << "\n"; }
+            print_entry("Load");
+            print_entry(std::to_string(load_ms) + "ms");
+            std::cout << std::endl << std::endl;
 
             print_entry("Benchmark");
             print_entry("Min");
@@ -234,27 +311,40 @@ namespace experimental {
             print_entry("Median");
             std::cout << std::endl;
 
-            output << benchmarks[0].get()->size();
-            tp << benchmarks[0].get()->size();
             for (auto& b: benchmarks) {
-                const BenchmarkInfo info = b.get()->info();
-                const auto ts = timings(b.get());
-
-                output << "," << ts.median;
-                tp << "," << get_throughput(b.get());
                 print_results(b.get());
             }
-            output << "\n";
-            tp << "\n";
+
+            if (append) {
+                output << benchmarks[0].get()->size();
+                tp << benchmarks[0].get()->size();
+                for (const auto& column : columns) {
+                    output << ",";
+                    tp << ",";
+                    if (column.second != nullptr) {
+                        output << timings(column.second).median;
+                        tp << get_throughput(column.second);
+                    }
+                }
+                output << "\n";
+                tp << "\n";
+            }
+            load << benchmarks[0].get()->size() << "," << load_ms << "\n";
 
             output.close();
             tp.close();
+            load.close();
         }
 
     private:
         std::vector <std::unique_ptr<benchmark>> benchmarks;
+        // CSV columns in order of registration, no benchmark for skipped ones.
+        std::vector<std::pair<std::string, benchmark*>> columns;
         const std::string subfolder;
         const std::string input_file;
+        float load_ms = 0;
+        OutputFormat output_format = OutputFormat::csv;
+        unsigned int write_threads = default_thread_count();
 
         void run_benchmark(benchmark* b, const int r) {
             std::cout << "------------------------------------------------------------\n";
@@ -267,7 +357,11 @@ namespace experimental {
                 b->run();
             }
 
-            if (b->write_) { b->write(); }
+            if (b->write_) {
+                b->format_ = output_format;
+                b->writeThreads_ = write_threads;
+                b->write();
+            }
             if (b->check_) { std::cout << "Checking " << b->info().name << "\n"; b->check(); }
 
             b->teardown();
@@ -281,8 +375,10 @@ namespace experimental {
         };
 
         timing_results timings(benchmark* b) {
-            std::vector<float> timings = b->timings();
+            return summarize(b->timings());
+        }
 
+        static timing_results summarize(std::vector<float> timings) {
             timings.erase(timings.begin()); // discard warmup run
             std::sort(timings.begin(), timings.end());
 
@@ -329,6 +425,24 @@ namespace experimental {
             print_entry(ss.str());
             ss.str("");
             std::cout << std::endl;
+
+            for (const auto& part : b->breakdown()) {
+                // Parts without a measured run (only the warmup) are skipped.
+                if (part.second.size() < 2) { continue; }
+                const auto partTimes = summarize(part.second);
+
+                print_entry("  " + part.first);
+                ss << partTimes.min << "ms";
+                print_entry(ss.str());
+                ss.str("");
+                ss << partTimes.max << "ms";
+                print_entry(ss.str());
+                ss.str("");
+                ss << partTimes.median << "ms";
+                print_entry(ss.str());
+                ss.str("");
+                std::cout << std::endl;
+            }
         }
 
         void print_entry(std::string entry) const {
@@ -20,11 +20,11 @@ namespace experimental {
         size_t elems_per_block;
         const size_t n_blocks = 64; // seems hardcoded in block_sort
 
-        // This is an internal copy of the unsorted digis
-        // which is copied to run the sort benchmark repeatedly.
-        CbmStsDigiInput* digis;
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
         digi_t* sorted;
-        bucket_t* bucket;
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
 
         digi_t** devOutput;
         digi_t* devBuffer; // Only used on device, not copied back to host.
@@ -34,9 +34,7 @@ namespace experimental {
         xpu::hd_buffer<index_t> buffEndIndex;
 
     public:
-        blocksort_bench(const CbmStsDigiInput* in_digis, const size_t in_n, const bool in_write = false, const bool in_check = true) : n(in_n), sorted(new digi_t[in_n]), digis(new CbmStsDigiInput[in_n]), benchmark(in_write, in_check) {
-            // Create an internal copy of the digis.
-            std::copy(in_digis, in_digis + in_n, digis);
+        blocksort_bench(const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true) : n(in_digis.size()), sorted(new digi_t[in_digis.size()]), digis(in_digis), benchmark(in_write, in_check) {
             elems_per_block = n / n_blocks;
         }
 
@@ -50,7 +48,13 @@ namespace experimental {
 
             buffDigis = xpu::hd_buffer<digi_t>(n);
 
-            bucket = new CbmStsDigiBucket(digis, n);
+            // Bucketed straight into the host half of the input buffer, a shared bucket is copied.
+            if (digis.bucket == nullptr) {
+                ownedBucket = new CbmStsDigiBucket(digis.columns, buffDigis.h());
+            } else {
+                std::copy(digis.bucket->digis, digis.bucket->digis + n, buffDigis.h());
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
 
             std::cout << "BlockSort: Buckets created." << "\n";
 
@@ -59,7 +63,6 @@ namespace experimental {
 
             std::copy(bucket->startIndex, bucket->startIndex + bucket->size(), buffStartIndex.h());
             std::copy(bucket->endIndex, bucket->endIndex + bucket->size(), buffEndIndex.h());
-            std::copy(bucket->digis, bucket->digis + n, buffDigis.h());
         }
 
         size_t size() const { return n; }
@@ -83,9 +86,11 @@ namespace experimental {
 
         digi_t* output() override { return sorted; }
 
+        const bucket_t* buckets() const override { return bucket; }
+
         void teardown() override {
-            delete[] digis;
-            delete bucket;
+            delete ownedBucket;
+            ownedBucket = nullptr;
             delete [] sorted;
             buffDigis.reset();
             buffStartIndex.reset();
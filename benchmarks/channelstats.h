@@ -0,0 +1,166 @@
+#pragma once
+
+#include "../src/types.h"
+#include "../src/datastructures.h"
+#include "../src/constants.h"
+#include "../src/sorting/JanSergeySortSingleBlock.h"
+
+// Include host functions to control the GPU.
+#include <xpu/host.h>
+#include "benchmark.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace experimental {
+
+    /// <summary>
+    /// ConcatSort (single block) that exports the per (bucket, channel) statistics the kernel builds anyway:
+    /// digi count, optionally charge sum and min/max time (see JanSergeySortSingleBlockStats).
+    /// Measured is the sort including the statistics, the download of the statistics is not.
+    /// With -w the statistics of the non-empty channels are written next to the sorted output.
+    /// </summary>
+    class channelstats_bench : public benchmark {
+
+        const size_t n;
+        const std::string name;
+        const bool withCharge;
+        const bool withTime;
+
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
+
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
+        xpu::hd_buffer<digi_t> buffDigis;
+        xpu::hd_buffer<digi_t> buffOutput;
+
+        xpu::hd_buffer<index_t> buffStartIndex;
+        xpu::hd_buffer<index_t> buffEndIndex;
+
+        // Row of channelCount entries per bucket.
+        xpu::hd_buffer<count_t> buffCount;
+        xpu::hd_buffer<unsigned long long> buffChargeSum;
+        xpu::hd_buffer<unsigned int> buffMinTime;
+        xpu::hd_buffer<unsigned int> buffMaxTime;
+
+    public:
+        channelstats_bench(const std::string in_name, const CbmStsDigiSource& in_digis, const bool in_charge = true, const bool in_time = true, const bool in_write = false, const bool in_check = true)
+            : n(in_digis.size()), name(in_name), withCharge(in_charge), withTime(in_time), digis(in_digis), benchmark(in_write, in_check) {
+            std::cout << "(" << info().name << ")" << " Charge=" << withCharge << " Time=" << withTime << "\n";
+        }
+
+        ~channelstats_bench() {}
+
+        BenchmarkInfo info() override { return BenchmarkInfo{name, JanSergeySortBlockDimX, 0}; }
+
+        void setup() override {
+            buffDigis = xpu::hd_buffer<digi_t>(n);
+            buffOutput = xpu::hd_buffer<digi_t>(n);
+
+            if (digis.bucket == nullptr) {
+                ownedBucket = new bucket_t(digis.columns, buffDigis.h());
+            } else {
+                std::copy(digis.bucket->digis, digis.bucket->digis + n, buffDigis.h());
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
+
+            buffStartIndex = xpu::hd_buffer<index_t>(bucket->size());
+            buffEndIndex = xpu::hd_buffer<index_t>(bucket->size());
+
+            std::copy(bucket->startIndex, bucket->startIndex + bucket->size(), buffStartIndex.h());
+            std::copy(bucket->endIndex, bucket->endIndex + bucket->size(), buffEndIndex.h());
+
+            const size_t entries = size_t(bucket->size()) * channelCount;
+            buffCount = xpu::hd_buffer<count_t>(entries);
+            if (withCharge) { buffChargeSum = xpu::hd_buffer<unsigned long long>(entries); }
+            if (withTime) {
+                buffMinTime = xpu::hd_buffer<unsigned int>(entries);
+                buffMaxTime = xpu::hd_buffer<unsigned int>(entries);
+            }
+        }
+
+        void teardown() override {
+            delete ownedBucket;
+            ownedBucket = nullptr;
+            buffStartIndex.reset();
+            buffEndIndex.reset();
+            buffDigis.reset();
+            buffOutput.reset();
+            buffCount.reset();
+            buffChargeSum.reset();
+            buffMinTime.reset();
+            buffMaxTime.reset();
+        }
+
+        void run() override {
+            xpu::copy(buffDigis, xpu::host_to_device);
+            xpu::copy(buffStartIndex, xpu::host_to_device);
+            xpu::copy(buffEndIndex, xpu::host_to_device);
+
+            xpu::run_kernel<JanSergeySortSingleBlockStats>(xpu::grid::n_blocks(bucket->size()), n, buffDigis.d(), buffStartIndex.d(), buffEndIndex.d(), buffOutput.d(),
+                buffCount.d(), withCharge ? buffChargeSum.d() : nullptr, withTime ? buffMinTime.d() : nullptr, withTime ? buffMaxTime.d() : nullptr);
+
+            // Copy result and statistics back to host.
+            xpu::copy(buffOutput, xpu::device_to_host);
+            xpu::copy(buffCount, xpu::device_to_host);
+            if (withCharge) { xpu::copy(buffChargeSum, xpu::device_to_host); }
+            if (withTime) {
+                xpu::copy(buffMinTime, xpu::device_to_host);
+                xpu::copy(buffMaxTime, xpu::device_to_host);
+            }
+        }
+
+        std::vector<float> timings() override { return xpu::get_timing<JanSergeySortSingleBlockStats>(); }
+
+        size_t size() const override { return n; }
+
+        digi_t* output() override { return buffOutput.h(); }
+
+        const bucket_t* buckets() const override { return bucket; }
+
+        size_t bytes() const override { return n * sizeof(digi_t); }
+
+        // Statistics of the last run, channelCount entries per bucket. Charge and time are nullptr if not exported.
+        const count_t* counts(const count_t b) { return buffCount.h() + size_t(b) * channelCount; }
+        const unsigned long long* chargeSums(const count_t b) { return withCharge ? buffChargeSum.h() + size_t(b) * channelCount : nullptr; }
+        const unsigned int* minTimes(const count_t b) { return withTime ? buffMinTime.h() + size_t(b) * channelCount : nullptr; }
+        const unsigned int* maxTimes(const count_t b) { return withTime ? buffMaxTime.h() + size_t(b) * channelCount : nullptr; }
+
+        void write() override {
+            benchmark::write();
+
+            // One line per non-empty (bucket, channel).
+            std::ofstream out("output/" + filename() + "_channels.csv");
+            out << "bucket,address,channel,count,chargeSum,minTime,maxTime\n";
+
+            for (count_t b = 0; b < bucket->size(); b++) {
+                const count_t* count = counts(b);
+                for (int c = 0; c < channelCount; c++) {
+                    if (count[c] == 0) { continue; }
+
+                    out << b << "," << bucket->address()[b] << "," << c << "," << count[c] << ",";
+                    if (withCharge) { out << chargeSums(b)[c]; }
+                    out << ",";
+                    if (withTime) { out << minTimes(b)[c] << "," << maxTimes(b)[c]; } else { out << ","; }
+                    out << "\n";
+                }
+            }
+        }
+
+        void check() override {
+            benchmark::check();
+
+            // The counts must add up to the bucket sizes.
+            for (count_t b = 0; b < bucket->size(); b++) {
+                size_t sum = 0;
+                for (int c = 0; c < channelCount; c++) { sum += counts(b)[c]; }
+                if (sum != size_t(bucket->endIndex[b] - bucket->startIndex[b] + 1)) {
+                    std::cout << info().name << " Error: channel counts of bucket " << b << " add up to " << sum << "\n";
+                }
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../src/types.h"
+#include "../src/datastructures.h"
+#include "../src/countingsort.h"
+
+#include "benchmark.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace experimental {
+
+    enum HostSortMode { countingSort, bucketThenSort };
+
+    /// <summary>
+    /// Host sorting of the raw input columns, measured from the unbucketed input to the sorted output:
+    /// countingSort: CbmStsDigiCountingSort, one histogram over (address, channel) and one stable scatter.
+    /// bucketThenSort: CbmStsDigiBucket, then a stable sort by channel per bucket (the time order comes from the input,
+    /// as for the counting sort). Both produce the same layout.
+    /// </summary>
+    class countingsort_bench : public benchmark {
+
+        const HostSortMode mode;
+        const size_t n;
+        const unsigned int threads;
+
+        // The unsorted input (not owned).
+        const CbmStsDigiColumns columns;
+        std::vector<digi_t> output_;
+
+        // Reused across runs, as in a continuous loop.
+        CbmStsDigiCountingSort engine;
+        CbmStsDigiBucket bucket;
+        // View of the counting sort result.
+        std::unique_ptr<bucket_t> view;
+
+    public:
+        countingsort_bench(const CbmStsDigiColumns& in_columns, const HostSortMode in_mode, const unsigned int in_threads = default_thread_count(), const bool in_write = false, const bool in_check = true)
+            : mode(in_mode), n(in_columns.n), threads(in_threads), columns(in_columns), benchmark(in_write, in_check) {}
+
+        ~countingsort_bench() {}
+
+        static std::string name(const HostSortMode mode) {
+            return mode == HostSortMode::countingSort ? "Host counting sort (address, channel)" : "Host bucketing + std::stable_sort";
+        }
+
+        BenchmarkInfo info() override {
+            return BenchmarkInfo{name(mode), 0, 0};
+        }
+
+        void setup() override {
+            output_.resize(n);
+        }
+
+        void teardown() override {
+            view.reset();
+            output_ = std::vector<digi_t>();
+        }
+
+        void run() override {
+            const auto started = std::chrono::high_resolution_clock::now();
+
+            if (mode == HostSortMode::countingSort) {
+                engine.sort(columns, output_.data(), threads);
+            } else {
+                bucket.reset(columns, output_.data(), threads);
+                parallel_for(bucket.size(), threads, [&](const size_t b) {
+                    std::stable_sort(output_.data() + bucket.begin(b), output_.data() + bucket.end(b) + 1, [](const digi_t& a, const digi_t& b) { return a.channel < b.channel; });
+                });
+            }
+
+            const auto done = std::chrono::high_resolution_clock::now();
+            timings_.push_back(std::chrono::duration<float, std::milli>(done - started).count());
+
+            if (mode == HostSortMode::countingSort) {
+                view.reset(new bucket_t(n, engine.size(), output_.data(), engine.startIndex, engine.endIndex, engine.address(), engine.channelSplitIndex));
+            }
+        }
+
+        size_t size() const override { return n; }
+
+        digi_t* output() override { return output_.data(); }
+
+        const bucket_t* buckets() const override { return mode == HostSortMode::countingSort ? view.get() : &bucket; }
+
+        size_t bytes() const override { return n * sizeof(digi_t); }
+
+    };
+
+}
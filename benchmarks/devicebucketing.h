@@ -0,0 +1,190 @@
+#pragma once
+
+#include "../src/types.h"
+#include "../src/datastructures.h"
+#include "../src/constants.h"
+#include "../src/address.h"
+#include "../src/algo/Bucketing.h"
+
+// Include host functions to control the GPU.
+#include <xpu/host.h>
+#include "benchmark.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace experimental {
+
+    /// <summary>
+    /// Uploads the raw input columns and buckets them on the device (kernels in algo/Bucketing.cpp) before
+    /// the bucket-wise sort, so no host side grouping is needed. Measured is the bucketing plus the sort.
+    ///
+    /// Buckets are in ascending module key order (see sts_address::module_key), not in order of first appearance
+    /// as in CbmStsDigiBucket. Inputs where two addresses share a module key are rejected.
+    /// </summary>
+    template<typename Kernel>
+    class devicebucketing_bench : public benchmark {
+
+        const size_t n;
+        const std::string name;
+
+        // The unsorted input (not owned).
+        const CbmStsDigiColumns columns;
+
+        // Upper bound of the bucket count, the actual count is only known on the device.
+        const count_t maxBuckets;
+        // Input chunks, one block each in counting and scattering.
+        const count_t chunks;
+        const size_t chunkSize;
+
+        xpu::hd_buffer<address_t> buffAddress;
+        xpu::hd_buffer<unsigned short> buffChannel;
+        xpu::hd_buffer<unsigned int> buffTime;
+        xpu::hd_buffer<unsigned short> buffCharge;
+
+        count_t* devKeyCount;
+        address_t* devKeyAddress;
+        count_t* devKeyBucket;
+        count_t* devBlockOffset; // Per chunk and bucket, only used on device.
+
+        // meta[0]: bucket count, meta[1]: module key collision.
+        xpu::hd_buffer<count_t> buffMeta;
+        xpu::hd_buffer<digi_t> buffDigis;
+        xpu::hd_buffer<digi_t> buffOutput;
+        xpu::hd_buffer<index_t> buffStartIndex;
+        xpu::hd_buffer<index_t> buffEndIndex;
+        xpu::hd_buffer<address_t> buffAddresses;
+
+        // View of the downloaded bucket layout.
+        bucket_t* bucket = nullptr;
+
+        // The sort kernel is shared with other benchmarks, only its timings from this one are summed.
+        kernel_timings<Kernel> kernelTimings;
+
+        static count_t chunk_count(const size_t n, const count_t maxBuckets) {
+            // ~4096 digis per chunk, but the chunk offsets (chunks x buckets) are kept below 64MB.
+            const size_t byDigis = (n + 4095) / 4096;
+            const size_t byOffsets = (size_t(1) << 24) / std::max<size_t>(maxBuckets, 1);
+            return static_cast<count_t>(std::max<size_t>(1, std::min<size_t>({byDigis, byOffsets, 1024})));
+        }
+
+    public:
+        devicebucketing_bench(const std::string in_name, const CbmStsDigiColumns& in_columns, const bool in_write = false, const bool in_check = true)
+            : n(in_columns.n), name(in_name), columns(in_columns),
+              maxBuckets(static_cast<count_t>(std::min<size_t>(in_columns.n, sts_address::kModuleKeyCount))),
+              chunks(chunk_count(in_columns.n, maxBuckets)),
+              chunkSize((in_columns.n + chunks - 1) / chunks),
+              benchmark(in_write, in_check) {
+            std::cout << "(" << info().name << ")" << " Chunks=" << chunks << "\n";
+        }
+
+        ~devicebucketing_bench() {}
+
+        BenchmarkInfo info() override { return BenchmarkInfo{name, BucketingBlockDimX, 0}; }
+
+        void setup() override {
+            buffAddress = xpu::hd_buffer<address_t>(n);
+            buffChannel = xpu::hd_buffer<unsigned short>(n);
+            buffTime = xpu::hd_buffer<unsigned int>(n);
+            buffCharge = xpu::hd_buffer<unsigned short>(n);
+
+            std::copy(columns.address, columns.address + n, buffAddress.h());
+            std::copy(columns.channel, columns.channel + n, buffChannel.h());
+            std::copy(columns.time, columns.time + n, buffTime.h());
+            std::copy(columns.charge, columns.charge + n, buffCharge.h());
+
+            devKeyCount = xpu::device_malloc<count_t>(sts_address::kModuleKeyCount);
+            devKeyAddress = xpu::device_malloc<address_t>(sts_address::kModuleKeyCount);
+            devKeyBucket = xpu::device_malloc<count_t>(sts_address::kModuleKeyCount);
+            devBlockOffset = xpu::device_malloc<count_t>(size_t(chunks) * maxBuckets);
+
+            buffMeta = xpu::hd_buffer<count_t>(2);
+            buffDigis = xpu::hd_buffer<digi_t>(n);
+            buffOutput = xpu::hd_buffer<digi_t>(n);
+            buffStartIndex = xpu::hd_buffer<index_t>(maxBuckets);
+            buffEndIndex = xpu::hd_buffer<index_t>(maxBuckets);
+            buffAddresses = xpu::hd_buffer<address_t>(maxBuckets);
+
+            kernelTimings.start();
+        }
+
+        void teardown() override {
+            kernelTimings.stop();
+            delete bucket;
+            bucket = nullptr;
+
+            xpu::free(devKeyCount);
+            xpu::free(devKeyAddress);
+            xpu::free(devKeyBucket);
+            xpu::free(devBlockOffset);
+
+            buffAddress.reset();
+            buffChannel.reset();
+            buffTime.reset();
+            buffCharge.reset();
+            buffMeta.reset();
+            buffDigis.reset();
+            buffOutput.reset();
+            buffStartIndex.reset();
+            buffEndIndex.reset();
+            buffAddresses.reset();
+        }
+
+        void run() override {
+            xpu::copy(buffAddress, xpu::host_to_device);
+            xpu::copy(buffChannel, xpu::host_to_device);
+            xpu::copy(buffTime, xpu::host_to_device);
+            xpu::copy(buffCharge, xpu::host_to_device);
+
+            // Thread counts, the block size differs between the drivers.
+            xpu::run_kernel<BucketClear>(xpu::grid::n_threads(sts_address::kModuleKeyCount), devKeyCount, buffMeta.d());
+            xpu::run_kernel<BucketHistogram>(xpu::grid::n_blocks(chunks), n, buffAddress.d(), devKeyCount, devKeyAddress);
+            xpu::run_kernel<BucketOffsets>(xpu::grid::n_blocks(1), devKeyCount, devKeyAddress, devKeyBucket, buffStartIndex.d(), buffEndIndex.d(), buffAddresses.d(), buffMeta.d());
+            xpu::run_kernel<BucketCount>(xpu::grid::n_blocks(chunks), n, chunkSize, buffAddress.d(), devKeyBucket, devKeyAddress, buffMeta.d(), devBlockOffset, buffMeta.d() + 1);
+            xpu::run_kernel<BucketBlockOffsets>(xpu::grid::n_threads(maxBuckets), buffMeta.d(), chunks, buffStartIndex.d(), devBlockOffset);
+            xpu::run_kernel<BucketScatter>(xpu::grid::n_blocks(chunks), n, chunkSize, buffAddress.d(), buffChannel.d(), buffTime.d(), buffCharge.d(), devKeyBucket, buffMeta.d(), devBlockOffset, buffDigis.d());
+
+            // The sort is launched with one block per bucket, so the count is needed on the host.
+            xpu::copy(buffMeta, xpu::device_to_host);
+            if (buffMeta.h()[1] != 0) {
+                throw std::runtime_error("Device bucketing: two addresses share a module key, use host bucketing for this input.");
+            }
+            const count_t bucketCount = buffMeta.h()[0];
+
+            xpu::run_kernel<Kernel>(xpu::grid::n_blocks(bucketCount), n, buffDigis.d(), buffStartIndex.d(), buffEndIndex.d(), buffOutput.d());
+
+            // Copy result and bucket layout back to host.
+            xpu::copy(buffOutput, xpu::device_to_host);
+            xpu::copy(buffStartIndex, xpu::device_to_host);
+            xpu::copy(buffEndIndex, xpu::device_to_host);
+            xpu::copy(buffAddresses, xpu::device_to_host);
+
+            delete bucket;
+            bucket = new bucket_t(n, bucketCount, buffOutput.h(), buffStartIndex.h(), buffEndIndex.h(), buffAddresses.h());
+        }
+
+        // Bucketing and sort together, per run.
+        std::vector<float> timings() override {
+            std::vector<float> sum;
+            add_timings(sum, xpu::get_timing<BucketClear>());
+            add_timings(sum, xpu::get_timing<BucketHistogram>());
+            add_timings(sum, xpu::get_timing<BucketOffsets>());
+            add_timings(sum, xpu::get_timing<BucketCount>());
+            add_timings(sum, xpu::get_timing<BucketBlockOffsets>());
+            add_timings(sum, xpu::get_timing<BucketScatter>());
+            add_timings(sum, kernelTimings.get());
+            return sum;
+        }
+
+        size_t size() const override { return n; }
+
+        digi_t* output() override { return buffOutput.h(); }
+
+        const bucket_t* buckets() const override { return bucket; }
+
+        size_t bytes() const override { return n * sizeof(digi_t); }
+
+    };
+
+}
@@ -2,6 +2,7 @@
 
 #include "../src/types.h"
 #include "../src/datastructures.h"
+#include "../src/layout.h"
 
 // Include host functions to control the GPU.
 #include <xpu/host.h>
@@ -9,10 +10,15 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <stdexcept>
+#include <type_traits>
 
 namespace experimental {
 
-    template<typename Kernel>
+    // SplitBySide: the kernel takes the channelSplitIndex of the buckets as last argument (JanSergeySort, JanSergeySortParInsert).
+    // With two blocks per bucket, one sorts the front side, the other the back side.
+    // Layout: CbmStsDigiAoS, or CbmStsDigiSoA for the ...SoA kernels, which take the input as separate columns (SoADigis).
+    template<typename Kernel, bool SplitBySide = false, typename Layout = CbmStsDigiAoS>
     class jansergeysort_bench : public benchmark {
 
         const size_t n;
@@ -20,18 +26,44 @@ namespace experimental {
         const std::string name;
 
         // Big difference here is that the digis are grouped in buckets and then bucket-wise sorted.
-        bucket_t* bucket;
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
 
-        CbmStsDigiInput* digis;
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
         xpu::hd_buffer<digi_t> buffDigis;
         xpu::hd_buffer<digi_t> buffOutput;
 
+        // Input columns of the SoA layout, instead of buffDigis.
+        xpu::hd_buffer<unsigned short> buffChannel;
+        xpu::hd_buffer<unsigned int> buffTime;
+        xpu::hd_buffer<unsigned short> buffCharge;
+
+        static constexpr bool soa = std::is_same<Layout, CbmStsDigiSoA>::value;
+
         xpu::hd_buffer<index_t> buffStartIndex;
         xpu::hd_buffer<index_t> buffEndIndex;
+        xpu::hd_buffer<index_t> buffChannelSplitIndex;
+
+        // The kernel may be shared with other benchmarks.
+        kernel_timings<Kernel> kernelTimings;
+
+        // input: the digis (AoS) or SoADigis.
+        template<typename Input>
+        void launch(const Input input) {
+            xpu::copy(buffStartIndex, xpu::host_to_device);
+            xpu::copy(buffEndIndex, xpu::host_to_device);
+
+            if constexpr (SplitBySide) {
+                xpu::copy(buffChannelSplitIndex, xpu::host_to_device);
+                xpu::run_kernel<Kernel>(xpu::grid::n_blocks(bucket->size() * blocksPerBucket), n, input, buffStartIndex.d(), buffEndIndex.d(), buffOutput.d(), buffChannelSplitIndex.d());
+            } else {
+                xpu::run_kernel<Kernel>(xpu::grid::n_blocks(bucket->size() * blocksPerBucket), n, input, buffStartIndex.d(), buffEndIndex.d(), buffOutput.d());
+            }
+        }
 
     public:
-        jansergeysort_bench(const std::string in_name, const CbmStsDigiInput* in_digis, const size_t in_n, const bool in_write = false, const bool in_check = true, unsigned int in_block_per_bucket = 2) : n(in_n), digis(new CbmStsDigiInput[in_n]), name(in_name), blocksPerBucket(in_block_per_bucket), benchmark(in_write, in_check) {
-            std::copy(in_digis, in_digis + in_n, digis);
+        jansergeysort_bench(const std::string in_name, const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true, unsigned int in_block_per_bucket = 2) : n(in_digis.size()), digis(in_digis), name(in_name), blocksPerBucket(in_block_per_bucket), benchmark(in_write, in_check) {
             std::cout << "(" << info().name << ")" << " Block per bucket=" << blocksPerBucket << "\n";
         }
 
@@ -43,10 +75,31 @@ namespace experimental {
         }
 
         void setup() {
-            buffDigis = xpu::hd_buffer<digi_t>(n);        
             buffOutput = xpu::hd_buffer<digi_t>(n);
 
-            bucket = new bucket_t(digis, n);
+            // Bucketed straight into the host half of the input buffer(s), a shared bucket is copied.
+            if constexpr (soa) {
+                buffChannel = xpu::hd_buffer<unsigned short>(n);
+                buffTime = xpu::hd_buffer<unsigned int>(n);
+                buffCharge = xpu::hd_buffer<unsigned short>(n);
+                const CbmStsDigiSoA columns{buffChannel.h(), buffTime.h(), buffCharge.h()};
+
+                if (digis.bucket == nullptr) {
+                    ownedBucket = new bucket_t();
+                    ownedBucket->reset(digis.columns, columns);
+                } else {
+                    for (size_t i = 0; i < n; i++) { columns.set(i, digis.bucket->digis[i]); }
+                }
+            } else {
+                buffDigis = xpu::hd_buffer<digi_t>(n);
+
+                if (digis.bucket == nullptr) {
+                    ownedBucket = new bucket_t(digis.columns, buffDigis.h());
+                } else {
+                    std::copy(digis.bucket->digis, digis.bucket->digis + n, buffDigis.h());
+                }
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
             std::cout << "Buckets created." << "\n";
 
             buffStartIndex = xpu::hd_buffer<index_t>(bucket->size());
@@ -55,39 +108,56 @@ namespace experimental {
             std::copy(bucket->startIndex, bucket->startIndex + bucket->size(), buffStartIndex.h());
             std::copy(bucket->endIndex, bucket->endIndex + bucket->size(), buffEndIndex.h());
 
-            std::copy(bucket->digis, bucket->digis + n, buffDigis.h());
+            if (SplitBySide) {
+                if (bucket->channelSplitIndex == nullptr) {
+                    throw std::runtime_error(info().name + ": input buckets are not split by side");
+                }
+                buffChannelSplitIndex = xpu::hd_buffer<index_t>(bucket->size());
+                std::copy(bucket->channelSplitIndex, bucket->channelSplitIndex + bucket->size(), buffChannelSplitIndex.h());
+            }
+
+            kernelTimings.start();
         }
 
         void teardown() override {
-            delete[] digis;
-            delete bucket;
+            kernelTimings.stop();
+            delete ownedBucket;
+            ownedBucket = nullptr;
             buffStartIndex.reset();
             buffEndIndex.reset();
+            buffChannelSplitIndex.reset();
             buffDigis.reset();
+            buffChannel.reset();
+            buffTime.reset();
+            buffCharge.reset();
             buffOutput.reset();
         }
 
         size_t size_n() const { return n; }
 
         void run() override {
-            xpu::copy(buffDigis, xpu::host_to_device);
-
-            xpu::copy(buffStartIndex, xpu::host_to_device);
-            xpu::copy(buffEndIndex, xpu::host_to_device);
-
-            // For now, one block per bucket.
-            xpu::run_kernel<Kernel>(xpu::grid::n_blocks(bucket->size() * blocksPerBucket), n, buffDigis.d(), buffStartIndex.d(), buffEndIndex.d(), buffOutput.d());
+            if constexpr (soa) {
+                xpu::copy(buffChannel, xpu::host_to_device);
+                xpu::copy(buffTime, xpu::host_to_device);
+                xpu::copy(buffCharge, xpu::host_to_device);
+                launch(SoADigis{buffChannel.d(), buffTime.d(), buffCharge.d()});
+            } else {
+                xpu::copy(buffDigis, xpu::host_to_device);
+                launch(buffDigis.d());
+            }
 
             // Copy result back to host.
             xpu::copy(buffOutput, xpu::device_to_host);
         }
 
-        std::vector<float> timings() override { return xpu::get_timing<Kernel>(); }
+        std::vector<float> timings() override { return kernelTimings.get(); }
 
         size_t size() const { return n; }
 
         digi_t* output() override { return buffOutput.h(); }
 
+        const bucket_t* buckets() const override { return bucket; }
+
         size_t bytes() const { return n * sizeof(digi_t); }
 
     };
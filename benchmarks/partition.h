@@ -17,7 +17,8 @@ namespace experimental {
         const size_t n;
         const std::string name;
 
-        CbmStsDigiInput* digis;
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
 
         xpu::hd_buffer<digi_t> hd_input;
         xpu::hd_buffer<digi_t> hd_output;
@@ -26,12 +27,11 @@ namespace experimental {
         xpu::hd_buffer<index_t> endIndex;
 
         // Big difference here is that the digis are grouped in buckets and then bucket-wise sorted.
-        CbmStsDigiBucket* bucket;
+        const CbmStsDigiBucket* bucket;
+        CbmStsDigiBucket* ownedBucket = nullptr;
 
     public:
-        partition_bench(const std::string in_name, const CbmStsDigiInput* in_digis, const size_t in_n, const bool in_write = false, const bool in_check = true) : n(in_n), digis(new CbmStsDigiInput[in_n]), name(in_name), benchmark(in_write, in_check) {
-            std::copy(in_digis, in_digis + in_n, digis);
-        }
+        partition_bench(const std::string in_name, const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true) : n(in_digis.size()), digis(in_digis), name(in_name), benchmark(in_write, in_check) {}
 
         ~partition_bench() {}
 
@@ -43,7 +43,13 @@ namespace experimental {
             hd_input = xpu::hd_buffer<digi_t>(n);        
             hd_output = xpu::hd_buffer<digi_t>(n);
 
-            bucket = new CbmStsDigiBucket(digis, n);
+            // Bucketed straight into the host half of the input buffer, a shared bucket is copied.
+            if (digis.bucket == nullptr) {
+                ownedBucket = new CbmStsDigiBucket(digis.columns, hd_input.h());
+            } else {
+                std::copy(digis.bucket->digis, digis.bucket->digis + n, hd_input.h());
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
             std::cout << "Parition CbmStsDigiBucket created." << "\n";
 
             startIndex = xpu::hd_buffer<index_t>(bucket->size());
@@ -52,12 +58,11 @@ namespace experimental {
             // Copy data to buffers.
             std::copy(bucket->startIndex, bucket->startIndex + bucket->size(), startIndex.h());
             std::copy(bucket->endIndex, bucket->endIndex + bucket->size(), endIndex.h());
-            std::copy(bucket->digis, bucket->digis + n, hd_input.h());
         }
 
         void teardown() override {
-            delete[] digis;
-            delete bucket;
+            delete ownedBucket;
+            ownedBucket = nullptr;
             startIndex.reset();
             endIndex.reset();
             hd_input.reset();
@@ -86,6 +91,8 @@ namespace experimental {
 
         digi_t* output() override { return hd_output.h(); }
 
+        const bucket_t* buckets() const override { return bucket; }
+
         size_t bytes() const { return n * sizeof(digi_t); }
 
     };
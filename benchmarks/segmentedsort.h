@@ -0,0 +1,258 @@
+#pragma once
+
+#include "../src/types.h"
+#include "../src/datastructures.h"
+#include "../src/constants.h"
+#include "../src/workplan.h"
+#include "../src/sorting/SegmentedSort.h"
+
+// Include host functions to control the GPU.
+#include <xpu/host.h>
+#include "benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace experimental {
+
+    /// <summary>
+    /// The chunked buckets (segments) of a CbmStsDigiWorkPlan on the device: their part of the plan, the counters and
+    /// the four chunk kernels. Shared by the benchmarks that sort large buckets this way, the packed part is left to
+    /// the caller. upload() once per plan and reset() in teardown, start() / stop() around the measured runs.
+    /// </summary>
+    class segmentedsort_chunks {
+
+        xpu::hd_buffer<index_t> buffChunkStart;
+        xpu::hd_buffer<index_t> buffChunkEnd;
+        xpu::hd_buffer<count_t> buffChunkGroup;
+        xpu::hd_buffer<count_t> buffGroupFirstChunk;
+        xpu::hd_buffer<index_t> buffSegmentStart;
+        xpu::hd_buffer<count_t> buffSegmentFirstGroup;
+
+        // channelCount counters per chunk and per group, only used on device.
+        count_t* devChunkOffset = nullptr;
+        count_t* devGroupOffset = nullptr;
+
+        count_t chunks = 0;
+        count_t groups = 0;
+        count_t segments = 0;
+
+        // The kernels may be shared with other benchmarks.
+        kernel_timings<SegmentedSortCount> countTimings;
+        kernel_timings<SegmentedSortScanChunks> scanChunksTimings;
+        kernel_timings<SegmentedSortScan> scanTimings;
+        kernel_timings<SegmentedSortScatter> scatterTimings;
+
+    public:
+        // At least one element, empty plan parts are not launched.
+        template<typename T>
+        static void upload(xpu::hd_buffer<T>& buffer, const std::vector<T>& v) {
+            buffer = xpu::hd_buffer<T>(std::max<size_t>(v.size(), 1));
+            std::copy(v.begin(), v.end(), buffer.h());
+        }
+
+        void upload(const CbmStsDigiWorkPlan& plan) {
+            reset();
+            chunks = plan.chunks();
+            groups = plan.groups();
+            segments = plan.segments();
+
+            upload(buffChunkStart, plan.chunkStart);
+            upload(buffChunkEnd, plan.chunkEnd);
+            upload(buffChunkGroup, plan.chunkGroup);
+            upload(buffGroupFirstChunk, plan.groupFirstChunk);
+            upload(buffSegmentStart, plan.segmentStart);
+            upload(buffSegmentFirstGroup, plan.segmentFirstGroup);
+
+            devChunkOffset = xpu::device_malloc<count_t>(std::max<size_t>(chunks, 1) * channelCount);
+            devGroupOffset = xpu::device_malloc<count_t>(std::max<size_t>(groups, 1) * channelCount);
+        }
+
+        void reset() {
+            xpu::free(devChunkOffset);
+            devChunkOffset = nullptr;
+            xpu::free(devGroupOffset);
+            devGroupOffset = nullptr;
+
+            buffChunkStart.reset();
+            buffChunkEnd.reset();
+            buffChunkGroup.reset();
+            buffGroupFirstChunk.reset();
+            buffSegmentStart.reset();
+            buffSegmentFirstGroup.reset();
+            chunks = groups = segments = 0;
+        }
+
+        /// <summary>
+        /// Sorts the segments of digis (on device) into output (on device). Nothing is launched without segments.
+        /// </summary>
+        void run(const size_t n, const digi_t* digis, digi_t* output) {
+            if (chunks == 0) { return; }
+
+            xpu::copy(buffChunkStart, xpu::host_to_device);
+            xpu::copy(buffChunkEnd, xpu::host_to_device);
+            xpu::copy(buffChunkGroup, xpu::host_to_device);
+            xpu::copy(buffGroupFirstChunk, xpu::host_to_device);
+            xpu::copy(buffSegmentStart, xpu::host_to_device);
+            xpu::copy(buffSegmentFirstGroup, xpu::host_to_device);
+            xpu::run_kernel<SegmentedSortCount>(xpu::grid::n_blocks(chunks), n, digis, buffChunkStart.d(), buffChunkEnd.d(), devChunkOffset);
+            xpu::run_kernel<SegmentedSortScanChunks>(xpu::grid::n_blocks(groups), buffGroupFirstChunk.d(), devChunkOffset, devGroupOffset);
+            xpu::run_kernel<SegmentedSortScan>(xpu::grid::n_blocks(segments), buffSegmentStart.d(), buffSegmentFirstGroup.d(), devGroupOffset);
+            xpu::run_kernel<SegmentedSortScatter>(xpu::grid::n_blocks(chunks), n, digis, buffChunkStart.d(), buffChunkEnd.d(), buffChunkGroup.d(), devGroupOffset, devChunkOffset, output);
+        }
+
+        void start() {
+            countTimings.start();
+            scanChunksTimings.start();
+            scanTimings.start();
+            scatterTimings.start();
+        }
+
+        void stop() {
+            countTimings.stop();
+            scanChunksTimings.stop();
+            scanTimings.stop();
+            scatterTimings.stop();
+        }
+
+        /// <summary>
+        /// Time of the chunk kernels per measured run, the runs without segments have none.
+        /// </summary>
+        std::vector<float> timings() const {
+            std::vector<float> sum;
+            for (const auto& part : breakdown()) { benchmark::add_timings(sum, part.second); }
+            return sum;
+        }
+
+        std::vector<std::pair<std::string, std::vector<float>>> breakdown() const {
+            return {
+                {"Chunk count", countTimings.get()},
+                {"Chunk scan (groups)", scanChunksTimings.get()},
+                {"Chunk scan (segments)", scanTimings.get()},
+                {"Chunk scatter", scatterTimings.get()},
+            };
+        }
+
+    };
+
+    /// <summary>
+    /// ConcatSort over a CbmStsDigiWorkPlan: small buckets packed several per block, larger buckets cut into chunks
+    /// sorted by cooperating blocks (SegmentedSort kernels). The plan depends only on the bucket layout and is made
+    /// once in setup, like the buckets. Measured are the kernels, breakdown() gives them one by one.
+    /// </summary>
+    class segmentedsort_bench : public benchmark {
+
+        const size_t n;
+        const std::string name;
+
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
+
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
+        xpu::hd_buffer<digi_t> buffDigis;
+        xpu::hd_buffer<digi_t> buffOutput;
+
+        CbmStsDigiWorkPlan plan;
+
+        xpu::hd_buffer<index_t> buffSmallStart;
+        xpu::hd_buffer<index_t> buffSmallEnd;
+        xpu::hd_buffer<index_t> buffSmallSlot;
+        xpu::hd_buffer<count_t> buffPackedFirst;
+        segmentedsort_chunks chunks;
+
+        // The kernel may be shared with other benchmarks.
+        kernel_timings<SegmentedSortPacked> packedTimings;
+
+    public:
+        segmentedsort_bench(const std::string in_name, const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true, const index_t in_chunk_size = 4096)
+            : n(in_digis.size()), name(in_name), digis(in_digis), plan(SegmentedSortBlockDimX, in_chunk_size), benchmark(in_write, in_check) {
+            std::cout << "(" << info().name << ")" << " Packed capacity=" << plan.packedCapacity << " Chunk size=" << plan.chunkSize << " Group size=" << plan.groupSize << "\n";
+        }
+
+        ~segmentedsort_bench() {}
+
+        BenchmarkInfo info() override { return BenchmarkInfo{name, SegmentedSortBlockDimX, 0}; }
+
+        void setup() override {
+            buffDigis = xpu::hd_buffer<digi_t>(n);
+            buffOutput = xpu::hd_buffer<digi_t>(n);
+
+            if (digis.bucket == nullptr) {
+                ownedBucket = new bucket_t(digis.columns, buffDigis.h());
+            } else {
+                std::copy(digis.bucket->digis, digis.bucket->digis + n, buffDigis.h());
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
+
+            const auto started = std::chrono::high_resolution_clock::now();
+            plan.plan(*bucket);
+            const float planMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - started).count();
+
+            std::cout << "Work plan: " << plan.blocks() << " packed blocks (" << plan.smallStart.size() << " buckets), "
+                      << plan.segments() << " segments in " << plan.chunks() << " chunks (" << plan.groups() << " groups), " << planMs << "ms\n";
+
+            segmentedsort_chunks::upload(buffSmallStart, plan.smallStart);
+            segmentedsort_chunks::upload(buffSmallEnd, plan.smallEnd);
+            segmentedsort_chunks::upload(buffSmallSlot, plan.smallSlot);
+            segmentedsort_chunks::upload(buffPackedFirst, plan.packedFirst);
+            chunks.upload(plan);
+
+            packedTimings.start();
+            chunks.start();
+        }
+
+        void teardown() override {
+            packedTimings.stop();
+            chunks.stop();
+
+            delete ownedBucket;
+            ownedBucket = nullptr;
+
+            chunks.reset();
+
+            buffSmallStart.reset();
+            buffSmallEnd.reset();
+            buffSmallSlot.reset();
+            buffPackedFirst.reset();
+            buffDigis.reset();
+            buffOutput.reset();
+        }
+
+        void run() override {
+            xpu::copy(buffDigis, xpu::host_to_device);
+
+            if (plan.blocks() > 0) {
+                xpu::copy(buffSmallStart, xpu::host_to_device);
+                xpu::copy(buffSmallEnd, xpu::host_to_device);
+                xpu::copy(buffSmallSlot, xpu::host_to_device);
+                xpu::copy(buffPackedFirst, xpu::host_to_device);
+                xpu::run_kernel<SegmentedSortPacked>(xpu::grid::n_blocks(plan.blocks()), n, buffDigis.d(), buffSmallStart.d(), buffSmallEnd.d(), buffSmallSlot.d(), buffPackedFirst.d(), buffOutput.d());
+            }
+
+            chunks.run(n, buffDigis.d(), buffOutput.d());
+
+            // Copy result back to host.
+            xpu::copy(buffOutput, xpu::device_to_host);
+        }
+
+        std::vector<std::pair<std::string, std::vector<float>>> breakdown() override {
+            // Printed after teardown(), parts of the plan that were not launched simply have no timings.
+            std::vector<std::pair<std::string, std::vector<float>>> parts = chunks.breakdown();
+            parts.emplace(parts.begin(), "Packed buckets", packedTimings.get());
+            return parts;
+        }
+
+        size_t size() const override { return n; }
+
+        digi_t* output() override { return buffOutput.h(); }
+
+        const bucket_t* buckets() const override { return bucket; }
+
+        size_t bytes() const override { return n * sizeof(digi_t); }
+
+    };
+
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "../src/types.h"
+#include "../src/datastructures.h"
+#include "../src/constants.h"
+#include "../src/sorting/JanSergeySortSmall.h"
+#include "../src/sorting/JanSergeySortParScatter.h"
+#include "../src/sorting/JanSergeySortNarrow.h"
+#include "../src/workplan.h"
+
+// Include host functions to control the GPU.
+#include <xpu/host.h>
+#include "benchmark.h"
+#include "segmentedsort.h"
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace experimental {
+
+    /// <summary>
+    /// ConcatSort dispatched by bucket size: the buckets are split into three lists once per input, each sorted by the
+    /// kernel that suits its size. Small buckets (at most JanSergeySortSmallMaxSize digis) skip the channel histogram
+    /// (JanSergeySortSmall), mid-size buckets are sorted by one block (MidKernel), large buckets are cut into chunks
+    /// sorted by cooperating blocks (the chunked part of SegmentedSort), so that no block serialises a huge bucket.
+    /// Only the kernels of non-empty classes are launched.
+    /// Measured is the sum of the kernels, breakdown() gives them per class.
+    ///
+    /// MidKernel: JanSergeySortParScatter, or JanSergeySortNarrow (half the histogram footprint), which limits the
+    /// mid-size class to JanSergeySortNarrowMaxSize digis.
+    /// </summary>
+    template<typename MidKernel = JanSergeySortParScatter>
+    class sizeclass_bench : public benchmark {
+
+        static constexpr bool narrow = std::is_same<MidKernel, JanSergeySortNarrow>::value;
+        static constexpr index_t midMaxSize = narrow ? JanSergeySortNarrowMaxSize : ~index_t(0);
+        static constexpr size_t midHistogramBytes = narrow ? JanSergeySortNarrowHistogramBytes : channelCount * sizeof(count_t);
+        static constexpr size_t midSmemBytes = narrow ? JanSergeySortNarrowSmemBytes : JanSergeySortParScatterSmemBytes;
+
+        // Shared memory (KiB) and threads per SM of a few GPU generations, for the resident blocks printed on
+        // construction. Registers are not taken into account.
+        static constexpr size_t smemPerSMKiB[] = {64, 96, 164};
+        static constexpr size_t threadsPerSM = 2048;
+
+        // Start and end of the buckets of one class.
+        struct size_class {
+            std::vector<index_t> start;
+            std::vector<index_t> end;
+            size_t digis = 0;
+
+            xpu::hd_buffer<index_t> buffStartIndex;
+            xpu::hd_buffer<index_t> buffEndIndex;
+
+            count_t size() const { return static_cast<count_t>(start.size()); }
+
+            void upload() {
+                buffStartIndex = xpu::hd_buffer<index_t>(size());
+                buffEndIndex = xpu::hd_buffer<index_t>(size());
+                std::copy(start.begin(), start.end(), buffStartIndex.h());
+                std::copy(end.begin(), end.end(), buffEndIndex.h());
+            }
+
+            void reset() {
+                start.clear();
+                end.clear();
+                digis = 0;
+                buffStartIndex.reset();
+                buffEndIndex.reset();
+            }
+        };
+
+        const size_t n;
+        const std::string name;
+        // Buckets with more digis than this are cut into chunks.
+        const index_t largeSize;
+
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
+
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
+        xpu::hd_buffer<digi_t> buffDigis;
+        xpu::hd_buffer<digi_t> buffOutput;
+
+        size_class small;
+        size_class mid;
+        size_class large;
+
+        // Large buckets only: every one is larger than the packed capacity, so the plan is all segments.
+        CbmStsDigiWorkPlan largePlan;
+        segmentedsort_chunks largeChunks;
+
+        // The kernels may be shared with other benchmarks.
+        kernel_timings<JanSergeySortSmall> smallTimings;
+        kernel_timings<MidKernel> midTimings;
+
+        void print_class(const std::string& label, const size_class& c) const {
+            std::cout << " " << label << "=" << c.size() << " buckets (" << c.digis << " digis)";
+        }
+
+    public:
+        sizeclass_bench(const std::string in_name, const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true, const index_t in_large_size = 1 << 14)
+            : n(in_digis.size()), name(in_name), largeSize(in_large_size < midMaxSize ? in_large_size : midMaxSize), digis(in_digis), largePlan(JanSergeySortSmallMaxSize), benchmark(in_write, in_check) {
+            std::cout << "(" << info().name << ")" << " Small<=" << JanSergeySortSmallMaxSize << " Large>" << largeSize
+                      << " Mid shared memory=" << midSmemBytes << "B per block (histogram " << midHistogramBytes << "B), resident blocks per SM:";
+            for (const size_t kib : smemPerSMKiB) {
+                std::cout << " " << std::min(kib * 1024 / midSmemBytes, threadsPerSM / JanSergeySortBlockDimX) << " at " << kib << "KiB";
+            }
+            std::cout << " (at most " << threadsPerSM / JanSergeySortBlockDimX << " by threads)\n";
+        }
+
+        ~sizeclass_bench() {}
+
+        BenchmarkInfo info() override { return BenchmarkInfo{name, JanSergeySortBlockDimX, 0}; }
+
+        void setup() override {
+            buffDigis = xpu::hd_buffer<digi_t>(n);
+            buffOutput = xpu::hd_buffer<digi_t>(n);
+
+            if (digis.bucket == nullptr) {
+                ownedBucket = new bucket_t(digis.columns, buffDigis.h());
+            } else {
+                std::copy(digis.bucket->digis, digis.bucket->digis + n, buffDigis.h());
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
+
+            for (count_t b = 0; b < bucket->size(); b++) {
+                const index_t size = bucket->endIndex[b] + 1 - bucket->startIndex[b];
+                size_class& c = size <= JanSergeySortSmallMaxSize ? small : (size > largeSize ? large : mid);
+
+                c.start.push_back(bucket->startIndex[b]);
+                c.end.push_back(bucket->endIndex[b]);
+                c.digis += size;
+            }
+
+            small.upload();
+            mid.upload();
+            largePlan.plan(large.start.data(), large.end.data(), large.size());
+            largeChunks.upload(largePlan);
+
+            std::cout << "Size classes:";
+            print_class("Small", small);
+            print_class("Mid", mid);
+            print_class("Large", large);
+            std::cout << " in " << largePlan.chunks() << " chunks\n";
+
+            smallTimings.start();
+            midTimings.start();
+            largeChunks.start();
+        }
+
+        void teardown() override {
+            smallTimings.stop();
+            midTimings.stop();
+            largeChunks.stop();
+
+            delete ownedBucket;
+            ownedBucket = nullptr;
+            small.reset();
+            mid.reset();
+            large.reset();
+            largeChunks.reset();
+            buffDigis.reset();
+            buffOutput.reset();
+        }
+
+        void run() override {
+            xpu::copy(buffDigis, xpu::host_to_device);
+
+            if (small.size() > 0) {
+                xpu::copy(small.buffStartIndex, xpu::host_to_device);
+                xpu::copy(small.buffEndIndex, xpu::host_to_device);
+                const count_t blocks = (small.size() + JanSergeySortSmallBucketsPerBlock - 1) / JanSergeySortSmallBucketsPerBlock;
+                xpu::run_kernel<JanSergeySortSmall>(xpu::grid::n_blocks(blocks), n, buffDigis.d(), small.buffStartIndex.d(), small.buffEndIndex.d(), small.size(), buffOutput.d());
+            }
+
+            if (mid.size() > 0) {
+                xpu::copy(mid.buffStartIndex, xpu::host_to_device);
+                xpu::copy(mid.buffEndIndex, xpu::host_to_device);
+                xpu::run_kernel<MidKernel>(xpu::grid::n_blocks(mid.size()), n, buffDigis.d(), mid.buffStartIndex.d(), mid.buffEndIndex.d(), buffOutput.d());
+            }
+
+            largeChunks.run(n, buffDigis.d(), buffOutput.d());
+
+            // Copy result back to host.
+            xpu::copy(buffOutput, xpu::device_to_host);
+        }
+
+        std::vector<std::pair<std::string, std::vector<float>>> breakdown() override {
+            std::vector<std::pair<std::string, std::vector<float>>> parts;
+            // Printed after teardown(), empty classes simply have no timings.
+            parts.emplace_back("Small buckets", smallTimings.get());
+            parts.emplace_back("Mid-size buckets", midTimings.get());
+            parts.emplace_back("Large buckets", largeChunks.timings());
+            return parts;
+        }
+
+        size_t size() const override { return n; }
+
+        digi_t* output() override { return buffOutput.h(); }
+
+        const bucket_t* buckets() const override { return bucket; }
+
+        size_t bytes() const override { return n * sizeof(digi_t); }
+
+    };
+
+}
@@ -21,9 +21,11 @@ namespace experimental {
   
         const SortMode mode;
         const size_t n;
-        CbmStsDigiInput* digis;
+        // The unsorted input (not owned): columns, or an already bucketed input.
+        const CbmStsDigiSource digis;
         digi_t* output_;
-        bucket_t* bucket;
+        const bucket_t* bucket;
+        bucket_t* ownedBucket = nullptr;
 
     std::string get_mode() const {
         switch(mode) {
@@ -34,9 +36,7 @@ namespace experimental {
     }
 
     public:
-        stdsort_bench(const CbmStsDigiInput* in_digis, const size_t in_n, const SortMode in_mode, const bool in_write = false, const bool in_check = true) : n(in_n), mode(in_mode), digis(new CbmStsDigiInput[in_n]), output_(new digi_t[in_n]), benchmark(in_write, in_check) {
-            std::copy(in_digis, in_digis + n, digis);
-        }
+        stdsort_bench(const CbmStsDigiSource& in_digis, const SortMode in_mode, const bool in_write = false, const bool in_check = true) : n(in_digis.size()), mode(in_mode), digis(in_digis), output_(new digi_t[in_digis.size()]), benchmark(in_write, in_check) {}
 
         ~stdsort_bench() {}
 
@@ -45,12 +45,16 @@ namespace experimental {
         }
 
         void setup() override {
-            bucket = new bucket_t(digis, n);
+            if (digis.bucket == nullptr) {
+                ownedBucket = new bucket_t(digis.columns);
+            }
+            bucket = digis.bucket != nullptr ? digis.bucket : ownedBucket;
             std::cout << "Buckets created." << "\n";
         }
 
         void teardown() override {
-            delete[] digis;
+            delete ownedBucket;
+            ownedBucket = nullptr;
             delete[] output_;
         }
 
@@ -61,11 +65,6 @@ namespace experimental {
         }
 
         void run() override {
-            // Copy for each run a fresh output original digi array.
-            for (int i=0; i < n; i++) {
-                output_[i] = digi_t(digis[i].channel, digis[i].time, digis[i].charge);
-            }
-
             // Create a fresh copy, in-place sorting.
             std::copy(bucket->digis, bucket->digis + n, output_);
 
@@ -75,8 +74,9 @@ namespace experimental {
                 case SortMode::seq:
                     started = std::chrono::high_resolution_clock::now();
 
+                    // end() is inclusive.
                     for (int i = 0; i < bucket->size(); i++) {
-                        std::sort(output_ + bucket->begin(i), output_ + bucket->end(i), [](const digi_t& a, const digi_t& b) {
+                        std::sort(output_ + bucket->begin(i), output_ + bucket->end(i) + 1, [](const digi_t& a, const digi_t& b) {
                             return (((unsigned long int) a.channel) << 32 | (unsigned long int) (a.time)) < (((unsigned long int) b.channel) << 32 | (unsigned long int) (b.time));
                         });
                     }
@@ -88,7 +88,7 @@ namespace experimental {
                     started = std::chrono::high_resolution_clock::now();
 
                     for (int i = 0; i < bucket->size(); i++) {
-                        threads[i] = std::thread(sortBucket, output_ + bucket->begin(i), output_ + bucket->end(i));
+                        threads[i] = std::thread(sortBucket, output_ + bucket->begin(i), output_ + bucket->end(i) + 1);
                     }
                     for (auto& th : threads) {
                         th.join();
@@ -104,6 +104,8 @@ namespace experimental {
 
         digi_t* output() override { return output_; }
 
+        const bucket_t* buckets() const override { return bucket; }
+
         size_t bytes() const { return n * sizeof(digi_t); }
 
     }; // class
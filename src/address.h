@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+namespace experimental {
+
+    /// <summary>
+    /// Decoder of the STS address bit field, after CbmStsAddress (see the commented original in device.h).
+    /// The position of a digi in the detector hierarchy is packed into its address, so it is never stored
+    /// separately but decoded on demand.
+    /// </summary>
+    namespace sts_address {
+
+        enum level {
+            kStsSystem,
+            kStsUnit,
+            kStsLadder,
+            kStsHalfLadder,
+            kStsModule,
+            kStsSensor,
+            kStsSide,
+            kStsNofLevels
+        };
+
+        constexpr int32_t kVersionSize = 4;   // Bits for version number
+        constexpr int32_t kVersionShift = 28; // First bit for version number
+        constexpr int32_t kVersionMask = (1 << kVersionSize) - 1;
+
+        constexpr uint32_t kCurrentVersion = 1;
+
+        constexpr uint16_t kBits[kCurrentVersion + 1][kStsNofLevels] = {
+            // Version 0 (until 23 August 2017): system, unit, ladder, half-ladder, module, sensor, side
+            {4, 4, 4, 1, 3, 2, 1},
+            // Version 1 (current, since 23 August 2017)
+            {4, 6, 5, 1, 5, 4, 1}
+        };
+
+        constexpr uint32_t shift(const uint32_t version, const level l) {
+            uint32_t s = 0;
+            for (int i = 0; i < l; i++) { s += kBits[version][i]; }
+            return s;
+        }
+
+        constexpr uint32_t mask(const uint32_t version, const level l) { return (1u << kBits[version][l]) - 1; }
+
+        constexpr uint32_t version(const int32_t address) {
+            return (static_cast<uint32_t>(address) >> kVersionShift) & kVersionMask;
+        }
+
+        /// <summary>
+        /// Id of the element on the given level. Unknown versions are decoded as the current one.
+        /// </summary>
+        constexpr uint32_t element(const int32_t address, const level l) {
+            const uint32_t v = version(address) <= kCurrentVersion ? version(address) : kCurrentVersion;
+            return (static_cast<uint32_t>(address) >> shift(v, l)) & mask(v, l);
+        }
+
+        // Unit, ladder, half-ladder and module are adjacent in version 1 (bits 4 to 20): together they identify a module.
+        constexpr uint32_t kModuleKeyShift = 4;
+        constexpr uint32_t kModuleKeyBits = 6 + 5 + 1 + 5;
+        constexpr uint32_t kModuleKeyCount = 1u << kModuleKeyBits;
+
+        /// <summary>
+        /// Dense 17 bit index of the module of an address. Addresses that differ only outside these bits
+        /// (version, system, sensor, side) share a key.
+        /// </summary>
+        constexpr uint32_t module_key(const int32_t address) {
+            return (static_cast<uint32_t>(address) >> kModuleKeyShift) & (kModuleKeyCount - 1);
+        }
+
+    } // namespace sts_address
+
+}
@@ -0,0 +1,192 @@
+#include <xpu/device.h>
+#include "Bucketing.h"
+#include "../datastructures.h"
+#include "../address.h"
+
+XPU_IMAGE(experimental::BucketingKernel);
+
+namespace experimental {
+
+    constexpr count_t moduleKeyCount = sts_address::kModuleKeyCount;
+    constexpr count_t noBucket = ~count_t(0);
+
+    XPU_D inline count_t moduleKey(const address_t address) {
+        return (static_cast<count_t>(address) >> sts_address::kModuleKeyShift) & (moduleKeyCount - 1);
+    }
+
+    struct BucketingSmem {};
+
+    struct BucketOffsetsSmem {
+        // Per thread: digis and non-empty keys in its key range, then their exclusive sums. Sized for the largest block.
+        count_t digis[BucketingBlockDimX];
+        count_t buckets[BucketingBlockDimX];
+    };
+
+    struct BucketScatterSmem {
+        count_t tileBucket[BucketingBlockDimX];
+    };
+
+    // meta[0]: number of buckets, meta[1]: set if two addresses share a module key.
+    XPU_KERNEL(BucketClear, BucketingSmem, count_t* keyCount, count_t* meta) {
+        for (auto i = xpu::block_idx::x() * xpu::block_dim::x() + xpu::thread_idx::x(); i < moduleKeyCount; i += xpu::grid_dim::x() * xpu::block_dim::x()) {
+            keyCount[i] = 0;
+        }
+        if (xpu::block_idx::x() == 0 && xpu::thread_idx::x() == 0) {
+            meta[0] = 0;
+            meta[1] = 0;
+        }
+    }
+
+    XPU_KERNEL(BucketHistogram, BucketingSmem, const size_t n, const address_t* address, count_t* keyCount, address_t* keyAddress) {
+        for (size_t i = xpu::block_idx::x() * xpu::block_dim::x() + xpu::thread_idx::x(); i < n; i += xpu::grid_dim::x() * xpu::block_dim::x()) {
+            const count_t key = moduleKey(address[i]);
+            xpu::atomic_add(&keyCount[key], 1);
+            // Any address of the key: if they are not all the same, BucketCount reports it.
+            keyAddress[key] = address[i];
+        }
+    }
+
+    /// <summary>
+    /// Single block. Every non-empty module key becomes a bucket, in ascending key order.
+    /// The key ranges follow the launched block size, the CPU driver runs blocks of a single thread.
+    /// </summary>
+    XPU_KERNEL(BucketOffsets, BucketOffsetsSmem, const count_t* keyCount, const address_t* keyAddress, count_t* keyBucket, index_t* startIndex, index_t* endIndex, address_t* addresses, count_t* meta) {
+        const count_t keysPerThread = (moduleKeyCount + xpu::block_dim::x() - 1) / xpu::block_dim::x();
+
+        const count_t firstKey = xpu::thread_idx::x() * keysPerThread < moduleKeyCount ? xpu::thread_idx::x() * keysPerThread : moduleKeyCount;
+        const count_t lastKey = firstKey + keysPerThread < moduleKeyCount ? firstKey + keysPerThread : moduleKeyCount;
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 1. Sum up digis and non-empty keys of the thread's key range.
+        // -----------------------------------------------------------------------------------------------------------
+        count_t digis = 0;
+        count_t buckets = 0;
+        for (count_t key = firstKey; key < lastKey; key++) {
+            digis += keyCount[key];
+            buckets += keyCount[key] > 0;
+        }
+        smem.digis[xpu::thread_idx::x()] = digis;
+        smem.buckets[xpu::thread_idx::x()] = buckets;
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 2. Exclusive sum over the threads: O(blockDim) = O(1)
+        // -----------------------------------------------------------------------------------------------------------
+        if (xpu::thread_idx::x() == 0) {
+            count_t digiSum = 0;
+            count_t bucketSum = 0;
+            for (int i = 0; i < xpu::block_dim::x(); i++) {
+                const count_t d = smem.digis[i];
+                const count_t b = smem.buckets[i];
+                smem.digis[i] = digiSum;
+                smem.buckets[i] = bucketSum;
+                digiSum += d;
+                bucketSum += b;
+            }
+            meta[0] = bucketSum;
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 3. Bucket index, start and end index and address of each non-empty key.
+        // -----------------------------------------------------------------------------------------------------------
+        index_t offset = smem.digis[xpu::thread_idx::x()];
+        count_t bucket = smem.buckets[xpu::thread_idx::x()];
+        for (count_t key = firstKey; key < lastKey; key++) {
+            const count_t count = keyCount[key];
+            if (count == 0) {
+                keyBucket[key] = noBucket;
+                continue;
+            }
+
+            keyBucket[key] = bucket;
+            startIndex[bucket] = offset;
+            endIndex[bucket] = offset + count - 1;
+            addresses[bucket] = keyAddress[key];
+
+            offset += count;
+            bucket++;
+        }
+    }
+
+    /// <summary>
+    /// One block per input chunk: counts the digis per bucket of the chunk into its row of blockCount.
+    /// </summary>
+    XPU_KERNEL(BucketCount, BucketingSmem, const size_t n, const size_t chunkSize, const address_t* address, const count_t* keyBucket, const address_t* keyAddress, const count_t* meta, count_t* blockCount, count_t* collision) {
+        const count_t bucketCount = meta[0];
+        count_t* row = blockCount + size_t(xpu::block_idx::x()) * bucketCount;
+
+        const size_t begin = size_t(xpu::block_idx::x()) * chunkSize;
+        const size_t end = begin + chunkSize < n ? begin + chunkSize : n;
+
+        for (auto i = xpu::thread_idx::x(); i < bucketCount; i += xpu::block_dim::x()) {
+            row[i] = 0;
+        }
+        xpu::barrier();
+
+        for (size_t i = begin + xpu::thread_idx::x(); i < end; i += xpu::block_dim::x()) {
+            const count_t key = moduleKey(address[i]);
+            xpu::atomic_add(&row[keyBucket[key]], 1);
+
+            if (address[i] != keyAddress[key]) {
+                *collision = 1;
+            }
+        }
+    }
+
+    /// <summary>
+    /// One thread per bucket: turns the per chunk counts of a bucket into the write offsets of the chunks.
+    /// </summary>
+    XPU_KERNEL(BucketBlockOffsets, BucketingSmem, const count_t* meta, const count_t chunks, const index_t* startIndex, count_t* blockCount) {
+        const count_t bucketCount = meta[0];
+        const count_t bucket = xpu::block_idx::x() * xpu::block_dim::x() + xpu::thread_idx::x();
+        if (bucket >= bucketCount) { return; }
+
+        index_t offset = startIndex[bucket];
+        for (count_t c = 0; c < chunks; c++) {
+            const count_t count = blockCount[size_t(c) * bucketCount + bucket];
+            blockCount[size_t(c) * bucketCount + bucket] = offset;
+            offset += count;
+        }
+    }
+
+    /// <summary>
+    /// One block per input chunk, stable: the chunk is processed in tiles of blockDim digis. Each digi's rank among
+    /// the digis of the same bucket earlier in the tile gives its position after the ones of the previous tiles.
+    /// </summary>
+    XPU_KERNEL(BucketScatter, BucketScatterSmem, const size_t n, const size_t chunkSize, const address_t* address, const unsigned short* channel, const unsigned int* time, const unsigned short* charge, const count_t* keyBucket, const count_t* meta, count_t* blockOffset, digi_t* digis) {
+        const count_t bucketCount = meta[0];
+        count_t* offset = blockOffset + size_t(xpu::block_idx::x()) * bucketCount;
+
+        const size_t begin = size_t(xpu::block_idx::x()) * chunkSize;
+        const size_t end = begin + chunkSize < n ? begin + chunkSize : n;
+
+        for (size_t tile = begin; tile < end; tile += xpu::block_dim::x()) {
+            const size_t i = tile + xpu::thread_idx::x();
+            const bool valid = i < end;
+            const count_t bucket = valid ? keyBucket[moduleKey(address[i])] : noBucket;
+
+            smem.tileBucket[xpu::thread_idx::x()] = bucket;
+            xpu::barrier();
+
+            count_t rank = 0;
+            bool last = true;
+            for (int t = 0; t < xpu::block_dim::x(); t++) {
+                if (smem.tileBucket[t] != bucket) { continue; }
+                if (t < xpu::thread_idx::x()) { rank++; }
+                if (t > xpu::thread_idx::x()) { last = false; }
+            }
+
+            if (valid) {
+                digis[offset[bucket] + rank] = digi_t(channel[i], time[i], charge[i]);
+            }
+            // Every thread of the tile has read the offsets before they move on.
+            xpu::barrier();
+
+            if (valid && last) {
+                offset[bucket] += rank + 1;
+            }
+            xpu::barrier();
+        }
+    }
+}
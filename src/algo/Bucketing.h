@@ -0,0 +1,29 @@
+#pragma once
+
+#include <xpu/device.h>
+#include <cstddef> // for size_t
+#include "../datastructures.h"
+#include "../constants.h"
+#include "../types.h"
+
+namespace experimental {
+
+    // Device side bucketing of the raw input columns into the layout the sorting kernels consume
+    // (digis, startIndex, endIndex). Launched in declaration order, see benchmarks/devicebucketing.h.
+    struct BucketingKernel {};
+
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketClear, count_t*, count_t*);
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketHistogram, const size_t, const address_t*, count_t*, address_t*);
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketOffsets, const count_t*, const address_t*, count_t*, index_t*, index_t*, address_t*, count_t*);
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketCount, const size_t, const size_t, const address_t*, const count_t*, const address_t*, const count_t*, count_t*, count_t*);
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketBlockOffsets, const count_t*, const count_t, const index_t*, count_t*);
+    XPU_EXPORT_KERNEL(BucketingKernel, BucketScatter, const size_t, const size_t, const address_t*, const unsigned short*, const unsigned int*, const unsigned short*, const count_t*, const count_t*, count_t*, digi_t*);
+
+}
+
+XPU_BLOCK_SIZE_1D(experimental::BucketClear, experimental::BucketingBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::BucketHistogram, experimental::BucketingBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::BucketOffsets, experimental::BucketingBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::BucketCount, experimental::BucketingBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::BucketBlockOffsets, experimental::BucketingBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::BucketScatter, experimental::BucketingBlockDimX);
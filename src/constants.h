@@ -12,6 +12,7 @@ namespace experimental {
 
     constexpr int JanSergeySortBlockDimX = WarpSize * WarpMultiplier;
     constexpr int PartitionBlockDimX = WarpSize * WarpMultiplier;
+    constexpr int BucketingBlockDimX = WarpSize * WarpMultiplier;
     constexpr int BlockSortBlockDimX = 64;
     constexpr int BlockSortItemsPerThread = 8;
 }
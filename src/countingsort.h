@@ -0,0 +1,263 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#include "datastructures.h"
+#include "memory_stats.h"
+#include "parallel.h"
+
+namespace experimental {
+
+    /// <summary>
+    /// Sorts raw input columns on the host in a single stable scatter, without a separate bucketing pass:
+    /// the (address, channel) pairs are small dense keys, so one histogram over them gives every digi's final position.
+    /// Like the ConcatSort kernels, it relies on the input being ordered by time: within a channel the digis keep their
+    /// input order. The result is the layout of bucketing followed by a stable sort by channel: buckets in order of first
+    /// appearance of their address, front side before back side (channelSplitIndex), channels ascending.
+    ///
+    /// Kept across sort() calls like CbmStsDigiBucket: after the first input of a size, no further allocations.
+    /// </summary>
+    class CbmStsDigiCountingSort {
+
+        // Contiguous slice of the input, counted and scattered by one thread.
+        struct part_t {
+            size_t begin = 0;
+            size_t end = 0;
+            CbmStsAddressIndex index;
+            // Digis per part-local bucket.
+            std::vector<index_t> size;
+            // channelCount counters per part-local bucket, turned into write positions.
+            std::vector<index_t> counts;
+            // Global bucket per part-local bucket.
+            std::vector<count_t> bucket;
+            size_t reserved = 0;
+
+            size_t capacity_bytes() const { return index.capacity_bytes() + (size.capacity() + counts.capacity()) * sizeof(index_t) + bucket.capacity() * sizeof(count_t); }
+
+            void clear() {
+                index.clear();
+                size.clear();
+                counts.clear();
+                bucket.clear();
+            }
+        };
+
+        static constexpr count_t noBucket = ~count_t(0);
+
+        std::vector<part_t> parts_;
+        CbmStsAddressIndex index_;
+        // Part-local bucket of every (part, global bucket), noBucket if the address is not in the part.
+        std::vector<count_t> local_;
+        size_t reserved_ = 0;
+
+        // Threads of all parallel steps, kept across sort() calls.
+        worker_pool pool_;
+        size_t poolThreads_ = 0;
+
+        grow_buffer<address_t> addressStorage_;
+        grow_buffer<index_t> startStorage_;
+        grow_buffer<index_t> endStorage_;
+        grow_buffer<index_t> splitStorage_;
+
+        address_t* addresses_ = nullptr;
+        count_t bucketCount_ = 0;
+        size_t n_ = 0;
+
+        memory_stats stats_;
+
+    public:
+        // Start, end (inclusive) and first back side index per bucket, as in CbmStsDigiBucket. Valid until the next sort().
+        index_t* startIndex = nullptr;
+        index_t* endIndex = nullptr;
+        index_t* channelSplitIndex = nullptr;
+
+        CbmStsDigiCountingSort() {}
+
+        CbmStsDigiCountingSort(const CbmStsDigiCountingSort&) = delete;
+        CbmStsDigiCountingSort& operator=(const CbmStsDigiCountingSort&) = delete;
+
+        /// <summary>
+        /// Running time: O(n) + O(buckets * channelCount * parts), spread over `threads` threads.
+        ///
+        /// 1. Each part indexes its addresses and counts its digis per part-local bucket.
+        /// 2. The local indexes are merged in first-appearance order, exactly as in CbmStsDigiBucket::createBuckets.
+        /// 3. Each part counts its digis per (part-local bucket, channel).
+        /// 4. Per bucket (in parallel), the counters become write positions: channel by channel, each part after the
+        ///    earlier parts, so the scatter is stable and the result identical for any thread count.
+        /// 5. Each part writes its digis to their final positions in `out` (in.n digis, not owned).
+        ///
+        /// The counters take channelCount * sizeof(index_t) bytes per address and part. After step 2 the bucket count is
+        /// known, and the parts are limited so that all counters together stay below maxCounters (a single part needs
+        /// them anyway). If that takes fewer parts than step 1 used, steps 1 and 2 are repeated with them.
+        /// </summary>
+        void sort(const CbmStsDigiColumns& in, CbmStsDigi* out, const unsigned int threads = default_thread_count()) {
+            // Below this many digis per part, starting a thread costs more than it saves.
+            constexpr size_t minDigisPerPart = 1 << 16;
+            // 64MB of counters.
+            constexpr size_t maxCounters = size_t(1) << 24;
+
+            const page_fault_counter faults;
+            stats_ = memory_stats();
+            n_ = in.n;
+
+            size_t parts = std::max<size_t>(1, std::min<size_t>(std::max(threads, 1u), n_ / minDigisPerPart));
+            index(in, parts, threads);
+
+            const size_t maxParts = std::max<size_t>(1, maxCounters / (std::max<size_t>(bucketCount_, 1) * channelCount));
+            if (parts > maxParts) {
+                parts = maxParts;
+                index(in, parts, threads);
+                // Counters of earlier inputs in the parts no longer used count against the bound as well.
+                for (size_t t = parts; t < parts_.size(); t++) {
+                    parts_[t].counts = std::vector<index_t>();
+                    parts_[t].reserved = parts_[t].capacity_bytes();
+                }
+            }
+
+            // -----------------------------------------------------------------------------------
+            // 3. Count (address, channel) per part.
+            // -----------------------------------------------------------------------------------
+            pool_.run(parts, threads, [&](const size_t t) {
+                part_t& p = parts_[t];
+                p.counts.assign(size_t(p.index.size()) * channelCount, 0);
+                for (size_t i = p.begin; i < p.end; i++) {
+                    p.counts[size_t(p.index.find(in.address[i])) * channelCount + in.channel[i]]++;
+                }
+            });
+
+            addresses_ = addressStorage_.reserve(bucketCount_, stats_);
+            startIndex = startStorage_.reserve(bucketCount_, stats_);
+            endIndex = endStorage_.reserve(bucketCount_, stats_);
+            channelSplitIndex = splitStorage_.reserve(bucketCount_, stats_);
+
+            local_.assign(parts * size_t(bucketCount_), noBucket);
+            std::fill(endIndex, endIndex + bucketCount_, 0);
+            for (size_t t = 0; t < parts; t++) {
+                const part_t& p = parts_[t];
+                for (count_t b = 0; b < p.bucket.size(); b++) {
+                    local_[t * bucketCount_ + p.bucket[b]] = b;
+                    endIndex[p.bucket[b]] += p.size[b];
+                }
+            }
+
+            index_t sum = 0;
+            for (count_t g = 0; g < bucketCount_; g++) {
+                addresses_[g] = index_.address(g);
+                startIndex[g] = sum;
+                sum += endIndex[g];
+                endIndex[g] = sum - 1;
+            }
+
+            // -----------------------------------------------------------------------------------
+            // 4. Write position per (part, bucket, channel). Buckets are independent.
+            // -----------------------------------------------------------------------------------
+            pool_.run(bucketCount_, threads, [&](const size_t g) {
+                index_t pos = startIndex[g];
+                for (int c = 0; c < channelCount; c++) {
+                    if (c == CbmStsDigiBucket::frontChannels) { channelSplitIndex[g] = pos; }
+                    for (size_t t = 0; t < parts; t++) {
+                        const count_t b = local_[t * bucketCount_ + g];
+                        if (b == noBucket) { continue; }
+
+                        index_t& counter = parts_[t].counts[size_t(b) * channelCount + c];
+                        const index_t count = counter;
+                        counter = pos;
+                        pos += count;
+                    }
+                }
+            });
+
+            // -----------------------------------------------------------------------------------
+            // 5. Stable scatter to the final positions. The parts write disjoint positions.
+            // -----------------------------------------------------------------------------------
+            pool_.run(parts, threads, [&](const size_t t) {
+                part_t& p = parts_[t];
+                for (size_t i = p.begin; i < p.end; i++) {
+                    const count_t b = p.index.find(in.address[i]);
+                    out[p.counts[size_t(b) * channelCount + in.channel[i]]++] = in.digi(i);
+                }
+            });
+
+            trackWorkspace(parts);
+            faults.stop(stats_);
+        }
+
+        count_t size() const { return bucketCount_; }
+
+        size_t n() const { return n_; }
+
+        address_t* address() const { return addresses_; }
+
+        // Allocations and page faults of the last sort().
+        const memory_stats& stats() const { return stats_; }
+
+    private:
+        /// <summary>
+        /// Steps 1 and 2 with the input cut into `parts` parts: part indexes and sizes, global index and bucket count.
+        /// </summary>
+        void index(const CbmStsDigiColumns& in, const size_t parts, const unsigned int threads) {
+            const size_t step = (n_ + parts - 1) / parts;
+
+            if (parts_.size() < parts) { parts_.resize(parts); }
+            for (size_t t = 0; t < parts; t++) {
+                parts_[t].clear();
+                parts_[t].begin = std::min(t * step, n_);
+                parts_[t].end = std::min(parts_[t].begin + step, n_);
+            }
+
+            // -----------------------------------------------------------------------------------
+            // 1. Addresses and digis per part-local bucket.
+            // -----------------------------------------------------------------------------------
+            pool_.run(parts, threads, [&](const size_t t) {
+                part_t& p = parts_[t];
+                for (size_t i = p.begin; i < p.end; i++) {
+                    const count_t b = p.index.insert(in.address[i]);
+                    if (b == p.size.size()) { p.size.push_back(0); }
+                    p.size[b]++;
+                }
+            });
+
+            // -----------------------------------------------------------------------------------
+            // 2. Merge the local indexes in first-appearance order.
+            // -----------------------------------------------------------------------------------
+            index_.clear();
+            for (size_t t = 0; t < parts; t++) {
+                part_t& p = parts_[t];
+                p.bucket.resize(p.index.size());
+                for (count_t b = 0; b < p.index.size(); b++) {
+                    p.bucket[b] = index_.insert(p.index.address(b));
+                }
+            }
+            bucketCount_ = index_.size();
+        }
+
+        void trackWorkspace(const size_t parts) {
+            // The workspace grows inside the standard containers, it is counted once per container group that grew.
+            for (size_t t = 0; t < parts; t++) {
+                part_t& p = parts_[t];
+                const size_t bytes = p.capacity_bytes();
+                if (bytes > p.reserved) {
+                    stats_.allocations++;
+                    stats_.allocatedBytes += bytes - p.reserved;
+                    p.reserved = bytes;
+                }
+            }
+
+            const size_t bytes = index_.capacity_bytes() + local_.capacity() * sizeof(count_t) + parts_.capacity() * sizeof(part_t);
+            if (bytes > reserved_) {
+                stats_.allocations++;
+                stats_.allocatedBytes += bytes - reserved_;
+                reserved_ = bytes;
+            }
+
+            // One allocation per started thread, as in CbmStsDigiBucket.
+            if (pool_.size() > poolThreads_) {
+                stats_.allocations += pool_.size() - poolThreads_;
+                poolThreads_ = pool_.size();
+            }
+        }
+    };
+
+}
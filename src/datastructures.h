@@ -1,11 +1,17 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <unordered_map>
 #include <iomanip>
 #include "types.h"
 #include "constants.h"
+#include "address.h"
+#include "parallel.h"
+#include "memory_stats.h"
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 // Notice type alias last line.
 
@@ -47,76 +53,629 @@ namespace experimental {
     };
 #endif
 
-    // This is the data that is read from the CSV file. It contains more information than is relevant for the sorting benchmark.
-    struct CbmStsDigiInput {
-        int address;
-        int system;
-        int unit;
-        int ladder;
-        int half_ladder;
-        int module;
-        int sensor;
-        int side;
+    /// <summary>
+    /// Non-owning view of the columns that are relevant for sorting. Both the binary file format (mapped)
+    /// and CbmStsDigiColumnStore hand out these views, so the consumers never copy the input.
+    /// </summary>
+    struct CbmStsDigiColumns {
+        const address_t* address = nullptr;
+        const unsigned short* channel = nullptr;
+        const unsigned int* time = nullptr;
+        const unsigned short* charge = nullptr;
+        size_t n = 0;
+
+        CbmStsDigi digi(const size_t i) const { return CbmStsDigi(channel[i], time[i], charge[i]); }
+
+        // The hierarchy is not stored, it is decoded from the address on demand.
+        uint32_t element(const size_t i, const sts_address::level l) const { return sts_address::element(address[i], l); }
+        uint32_t system(const size_t i) const { return element(i, sts_address::kStsSystem); }
+        uint32_t unit(const size_t i) const { return element(i, sts_address::kStsUnit); }
+        uint32_t ladder(const size_t i) const { return element(i, sts_address::kStsLadder); }
+        uint32_t half_ladder(const size_t i) const { return element(i, sts_address::kStsHalfLadder); }
+        uint32_t module(const size_t i) const { return element(i, sts_address::kStsModule); }
+        uint32_t sensor(const size_t i) const { return element(i, sts_address::kStsSensor); }
+        uint32_t side(const size_t i) const { return element(i, sts_address::kStsSide); }
+
+        // View of the first count digis (-n cap).
+        CbmStsDigiColumns first(const size_t count) const {
+            CbmStsDigiColumns view = *this;
+            view.n = count < n ? count : n;
+            return view;
+        }
+    };
 
-        unsigned short channel;
-        unsigned short charge;
-        unsigned int time;
+    /// <summary>
+    /// Owning column storage, used when the input cannot be mapped as is (CSV input, -r repeat).
+    /// </summary>
+    class CbmStsDigiColumnStore {
+        std::vector<address_t> address_;
+        std::vector<unsigned short> channel_;
+        std::vector<unsigned int> time_;
+        std::vector<unsigned short> charge_;
 
-        CbmStsDigiInput() = default;
+    public:
+        CbmStsDigiColumnStore() = default;
 
-        CbmStsDigiInput(const int in_address, const int in_system, const int in_unit, const int in_ladder, const int in_half_ladder, const int in_module, const int in_sensor, const int in_side, const unsigned short in_channel, const unsigned int in_time, const unsigned short in_charge) : address(in_address), system(in_system), unit(in_unit), ladder(in_ladder), half_ladder(in_half_ladder), module(in_module), sensor(in_sensor), side(in_side), channel(in_channel), time(in_time), charge(in_charge) {}
+        // Each digi is repeated `repeat` times, as readCsv does it with the -r flag.
+        CbmStsDigiColumnStore(const CbmStsDigiColumns& digis, const unsigned int repeat) {
+            resize(digis.n * repeat);
+            assign(0, digis, repeat);
+        }
 
-        std::string to_string() { return "(address: " + to_zero_lead(address, 10) + ", channel: " + to_zero_lead(channel, 4) + ", time: " + to_zero_lead(time, 5) + ")"; }
+        // Sizes the columns for digis that are filled range by range (parallel loaders).
+        void resize(const size_t n) {
+            address_.resize(n);
+            channel_.resize(n);
+            time_.resize(n);
+            charge_.resize(n);
+        }
 
-    private:
-        static std::string to_zero_lead(const int value, const unsigned precision) {
-            std::ostringstream oss;
-            oss << std::setw(precision) << std::setfill('0') << value;
-            return oss.str();
+        // Writes one digi. Calls for different i may run concurrently.
+        void set(const size_t i, const address_t address, const unsigned short channel, const unsigned int time, const unsigned short charge) {
+            address_[i] = address;
+            channel_[i] = channel;
+            time_[i] = time;
+            charge_[i] = charge;
+        }
+
+        // Writes the digis, each repeated `repeat` times, starting at offset. Stops after `limit` written digis.
+        void assign(const size_t offset, const CbmStsDigiColumns& digis, const unsigned int repeat, const size_t limit = SIZE_MAX) {
+            size_t k = offset;
+            const size_t last = limit < SIZE_MAX - offset ? offset + limit : SIZE_MAX;
+            for (size_t i = 0; i < digis.n && k < last; i++) {
+                for (unsigned int r = 0; r < repeat && k < last; r++, k++) {
+                    address_[k] = digis.address[i];
+                    channel_[k] = digis.channel[i];
+                    time_[k] = digis.time[i];
+                    charge_[k] = digis.charge[i];
+                }
+            }
         }
+
+        size_t size() const { return address_.size(); }
+
+        CbmStsDigiColumns view() const { return CbmStsDigiColumns{address_.data(), channel_.data(), time_.data(), charge_.data(), address_.size()}; }
+    };
+
+    /// <summary>
+    /// Maps addresses to dense bucket indexes, numbered in the order the addresses first appear.
+    /// The common case is one address per module, so a table over the 17 bit module key (see sts_address::module_key)
+    /// resolves an address with one array access and one compare. Only an address that shares its module key with an
+    /// address seen before (i.e. differs in sensor, side, system or version) is looked up in a hash table.
+    /// </summary>
+    class CbmStsAddressIndex {
+        static constexpr count_t empty = ~count_t(0);
+
+        // Bucket of the first address seen per module key.
+        std::vector<count_t> slots;
+        std::vector<address_t> addresses_;
+
+        // Addresses that share their module key with an earlier one: open addressing with linear probing over a power
+        // of two table, at most half full. Plain arrays, so clear() keeps the memory like the slots.
+        std::vector<address_t> collisionAddress;
+        std::vector<count_t> collisionBucket;
+        count_t collisionCount = 0;
+
+        static uint32_t hash(const address_t address) {
+            // Finalizer of MurmurHash3: colliding addresses differ only in a few high bits.
+            uint32_t h = static_cast<uint32_t>(address);
+            h ^= h >> 16;
+            h *= 0x85ebca6bu;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35u;
+            h ^= h >> 16;
+            return h;
+        }
+
+        // Entry of the address, or the free entry where it belongs.
+        size_t collision_entry(const address_t address) const {
+            const size_t mask = collisionBucket.size() - 1;
+            size_t i = hash(address) & mask;
+            while (collisionBucket[i] != empty && collisionAddress[i] != address) { i = (i + 1) & mask; }
+            return i;
+        }
+
+        void grow_collisions() {
+            std::vector<address_t> oldAddress(std::max<size_t>(16, collisionBucket.size() * 2));
+            std::vector<count_t> oldBucket(oldAddress.size(), empty);
+            collisionAddress.swap(oldAddress);
+            collisionBucket.swap(oldBucket);
+
+            for (size_t i = 0; i < oldBucket.size(); i++) {
+                if (oldBucket[i] == empty) { continue; }
+                const size_t e = collision_entry(oldAddress[i]);
+                collisionAddress[e] = oldAddress[i];
+                collisionBucket[e] = oldBucket[i];
+            }
+        }
+
+    public:
+        CbmStsAddressIndex() : slots(sts_address::kModuleKeyCount, empty) {}
+
+        /// <summary>
+        /// Bucket of the address, a new bucket if the address was not seen before.
+        /// </summary>
+        count_t insert(const address_t address) {
+            count_t& slot = slots[sts_address::module_key(address)];
+            if (slot != empty && addresses_[slot] == address) { return slot; }
+
+            if (slot == empty) {
+                slot = size();
+                addresses_.push_back(address);
+                return slot;
+            }
+
+            if (2 * (size_t(collisionCount) + 1) > collisionBucket.size()) { grow_collisions(); }
+            const size_t e = collision_entry(address);
+            if (collisionBucket[e] != empty) { return collisionBucket[e]; }
+
+            const count_t b = size();
+            collisionAddress[e] = address;
+            collisionBucket[e] = b;
+            collisionCount++;
+            addresses_.push_back(address);
+            return b;
+        }
+
+        /// <summary>
+        /// Bucket of an address that was inserted before.
+        /// </summary>
+        count_t find(const address_t address) const {
+            const count_t slot = slots[sts_address::module_key(address)];
+            if (addresses_[slot] == address) { return slot; }
+            return collisionBucket[collision_entry(address)];
+        }
+
+        count_t size() const { return static_cast<count_t>(addresses_.size()); }
+
+        address_t address(const count_t b) const { return addresses_[b]; }
+
+        /// <summary>
+        /// Forgets all addresses but keeps the memory: only the slots that were used are emptied, O(size()). The collision
+        /// table is emptied if it was used, O(its capacity), at most twice the most collisions of any input so far.
+        /// </summary>
+        void clear() {
+            for (const address_t address : addresses_) { slots[sts_address::module_key(address)] = empty; }
+            addresses_.clear();
+            if (collisionCount > 0) {
+                std::fill(collisionBucket.begin(), collisionBucket.end(), empty);
+                collisionCount = 0;
+            }
+        }
+
+        size_t capacity_bytes() const { return slots.capacity() * sizeof(count_t) + addresses_.capacity() * sizeof(address_t) + collisionAddress.capacity() * sizeof(address_t) + collisionBucket.capacity() * sizeof(count_t); }
+    };
+
+    /// <summary>
+    /// Layout policies of the bucketed digis, the target of the bucketing scatter:
+    /// CbmStsDigiAoS is the flat digi array, CbmStsDigiSoA separate channel, time and charge arrays (n each, not owned),
+    /// so the histogram phase of the sort kernels reads only the channel column (see layout.h for the kernel side).
+    /// </summary>
+    struct CbmStsDigiAoS {
+        CbmStsDigi* digis = nullptr;
+
+        void set(const size_t pos, const CbmStsDigi& digi) const { digis[pos] = digi; }
+    };
+
+    struct CbmStsDigiSoA {
+        unsigned short* channel = nullptr;
+        unsigned int* time = nullptr;
+        unsigned short* charge = nullptr;
+
+        void set(const size_t pos, const CbmStsDigi& digi) const {
+            channel[pos] = digi.channel;
+            time[pos] = digi.time;
+            charge[pos] = digi.charge;
+        }
+    };
+
+    /// <summary>
+    /// Noise filter applied while bucketing: digis below the charge threshold and digis on masked
+    /// (hot or dead) channels are dropped before they are counted, so they never reach the transfers and sorters.
+    /// </summary>
+    class CbmStsDigiFilter {
+        unsigned short minCharge_ = 0;
+        // Bit per channel, only for addresses that have masked channels.
+        std::unordered_map<address_t, std::vector<uint64_t>> masks_;
+
+    public:
+        static constexpr size_t maskWords = (channelCount + 63) / 64;
+
+        explicit CbmStsDigiFilter(const unsigned short in_min_charge = 0) : minCharge_(in_min_charge) {}
+
+        void setMinCharge(const unsigned short charge) { minCharge_ = charge; }
+
+        unsigned short minCharge() const { return minCharge_; }
+
+        void mask(const address_t address, const unsigned short channel) {
+            if (channel >= channelCount) {
+                throw std::invalid_argument("Channel " + std::to_string(channel) + " is out of range");
+            }
+            std::vector<uint64_t>& row = masks_[address];
+            if (row.empty()) { row.assign(maskWords, 0); }
+            row[channel / 64] |= uint64_t(1) << (channel % 64);
+        }
+
+        // Channel mask of the address, nullptr if none of its channels is masked.
+        const uint64_t* channelMask(const address_t address) const {
+            const auto it = masks_.find(address);
+            return it != masks_.end() ? it->second.data() : nullptr;
+        }
+
+        const std::unordered_map<address_t, std::vector<uint64_t>>& masks() const { return masks_; }
+
+        static bool masked(const uint64_t* mask, const unsigned short channel) {
+            return mask != nullptr && channel < channelCount && ((mask[channel / 64] >> (channel % 64)) & 1);
+        }
+
+        // mask: channelMask() of the digi's address.
+        bool accepts(const uint64_t* mask, const unsigned short channel, const unsigned short charge) const {
+            return charge >= minCharge_ && !masked(mask, channel);
+        }
+
+        bool active() const { return minCharge_ > 0 || !masks_.empty(); }
+    };
+
+    /// <summary>
+    /// Digis of one address that passed and that were dropped by the filter.
+    /// </summary>
+    struct CbmStsModuleRejections {
+        address_t address;
+        count_t accepted;
+        count_t rejected;
     };
 
     /// <summary>
     /// The purpose of this class is to have a flat array that contains virtual buckets
     /// specified by start and end indexes for each addresses. The point is to copy the data structure
     /// -as is- to the GPU for further computation.
+    ///
+    /// Within a bucket the front side digis (channel < frontChannels) come first, the back side digis start at
+    /// channelSplitIndex, so two blocks can sort one bucket independently. Within each side the input order is kept.
+    ///
+    /// Optionally (splitTimeWindows) every bucket is split further by time window, see there.
+    ///
+    /// With a filter (setFilter) rejected digis are dropped during counting and scattering: n() counts the surviving
+    /// digis, addresses without any are not bucketed, rejections() reports the dropped digis per address.
+    ///
+    /// A bucket can be reused for the next input (timeslice) with reset(): all arrays and the bucketing workspace
+    /// keep their capacity and only grow if an input needs more, so a steady stream of similar inputs is bucketed
+    /// without allocating. stats() reports the allocations and page faults of the last bucketing. The bucketing threads
+    /// are kept as well (worker_pool), threads it starts count as allocations.
     /// </summary>
     class CbmStsDigiBucket {
-        address_t* addresses_;
-        std::unordered_map<address_t, count_t> addressCounter;
-        
-        /// <summary>
-        /// Die Vector is NOT sorted, this is just the order that the digi addresses first appeared.
-        /// Just used for the array layout to place the elements in a certain order. Which order is irrelevant.
-        /// </summary>
-        std::vector<address_t> addressOrder;
-
-        std::unordered_map<address_t, count_t> addressStartIndex;
-        CbmStsDigiInput* input;
-        size_t n_;
-        count_t bucketCount_;
+        // Owned storage, only grows. The public pointers point here unless the storage is external.
+        grow_buffer<CbmStsDigi> digiStorage_;
+        grow_buffer<index_t> startStorage_;
+        grow_buffer<index_t> endStorage_;
+        grow_buffer<index_t> splitStorage_;
+        grow_buffer<address_t> addressStorage_;
+        grow_buffer<uint32_t> windowStorage_;
+        grow_buffer<CbmStsDigi> scratchStorage_;
+
+        address_t* addresses_ = nullptr;
+
+        // Time window length and window index per bucket, 0 and nullptr if the buckets are not split by time.
+        uint32_t timeWindow_ = 0;
+        uint32_t* windows_ = nullptr;
+
+        // Views of external storage may be read-only (mapped snapshots) and are never rearranged.
+        bool view_ = false;
+
+        // Not owned, applied by every reset until it is replaced.
+        const CbmStsDigiFilter* filter_ = nullptr;
+
+        // Not owned, must outlive the bucket (or the next reset).
+        CbmStsDigiColumns input;
+        size_t n_ = 0;
+        count_t bucketCount_ = 0;
+
+        // Workspace of one contiguous input part, see createBuckets.
+        struct part_t {
+            size_t begin;
+            size_t end;
+            CbmStsAddressIndex index;
+            std::vector<count_t> counter;
+            std::vector<count_t> frontCounter;
+            std::vector<count_t> rejected;
+            // Filter mask per local bucket, looked up once per address and part.
+            std::vector<const uint64_t*> mask;
+            // Local to global bucket and the part's write positions in each of its buckets, per side.
+            std::vector<count_t> bucket;
+            std::vector<index_t> offset;
+            std::vector<index_t> backOffset;
+            // Workspace bytes after the last bucketing, to detect growth.
+            size_t reserved = 0;
+
+            size_t capacity_bytes() const { return index.capacity_bytes() + (counter.capacity() + frontCounter.capacity() + rejected.capacity() + bucket.capacity() + offset.capacity() + backOffset.capacity()) * sizeof(count_t) + mask.capacity() * sizeof(const uint64_t*); }
+
+            void clear() {
+                index.clear();
+                counter.clear();
+                frontCounter.clear();
+                rejected.clear();
+                mask.clear();
+                bucket.clear();
+                offset.clear();
+                backOffset.clear();
+            }
+        };
+
+        // Kept across resets. Parts are never dropped, only the first ones are used for smaller inputs.
+        std::vector<part_t> parts_;
+        CbmStsAddressIndex index_;
+        std::vector<index_t> size_;
+        std::vector<index_t> frontSize_;
+        std::vector<count_t> rejected_;
+        std::vector<index_t> next_;
+        std::vector<index_t> nextBack_;
+
+        // Time window workspace, per address bucket: counts per (window, side), first window, sub-bucket numbering,
+        // and a copy of the address level table.
+        std::vector<std::vector<index_t>> windowCounts_;
+        std::vector<uint32_t> firstWindow_;
+        std::vector<count_t> subBucket_;
+        std::vector<index_t> addressStart_;
+        std::vector<address_t> addressOf_;
+        size_t reserved_ = 0;
+
+        // Threads of all parallel steps, kept across resets.
+        worker_pool pool_;
+        size_t poolThreads_ = 0;
+
+        memory_stats stats_;
 
     public:
+        // Channels of the front (p) side, the back (n) side has the rest.
+        static constexpr unsigned short frontChannels = channelCount / 2;
+
         // Contains after construction the bucket with digis.
-        CbmStsDigi* digis;
+        CbmStsDigi* digis = nullptr;
 
         // Start and end indexes (not size) of digis.
-        index_t* startIndex;
-        index_t* endIndex;
+        index_t* startIndex = nullptr;
+        index_t* endIndex = nullptr;
+
+        // Index of the first back side digi per bucket, endIndex + 1 if the bucket has no back side digis.
+        index_t* channelSplitIndex = nullptr;
+
+        /// <summary>
+        /// Empty bucket, filled by reset().
+        /// </summary>
+        CbmStsDigiBucket() {}
+
+        CbmStsDigiBucket(const CbmStsDigiColumns& in_digis, const unsigned int threads = default_thread_count()) {
+            reset(in_digis, threads);
+        }
+
+        /// <summary>
+        /// Buckets the digis straight into `out` (n digis, not owned), e.g. the host half of the hd_buffer that
+        /// is copied to the device. Saves allocating the bucket's own array and copying it over.
+        /// </summary>
+        CbmStsDigiBucket(const CbmStsDigiColumns& in_digis, CbmStsDigi* out, const unsigned int threads = default_thread_count()) {
+            reset(in_digis, out, threads);
+        }
 
-        CbmStsDigiBucket(const CbmStsDigiInput* in_digis, const size_t in_n) : n_(in_n), digis(new CbmStsDigi[in_n]), input(new CbmStsDigiInput[in_n]) {
-            std::copy(in_digis, in_digis + in_n, input);
-            createBuckets();
+        /// <summary>
+        /// Only allocates the flat layout for n digis in bucketCount buckets. For loaders that produce
+        /// the bucketed layout directly (e.g. the archive decoder) and fill digis, indexes and addresses themselves,
+        /// followed by splitChannels().
+        /// </summary>
+        CbmStsDigiBucket(const size_t in_n, const count_t in_bucket_count) : n_(in_n), bucketCount_(in_bucket_count) {
+            digis = digiStorage_.reserve(n_, stats_);
+            reserveIndexes();
+        }
+
+        /// <summary>
+        /// Non-owning view of an already bucketed layout in external storage (e.g. a mapped snapshot).
+        /// Nothing is copied, the storage must outlive the bucket. Without split indexes, the layout is not split by side.
+        /// </summary>
+        CbmStsDigiBucket(const size_t in_n, const count_t in_bucket_count, CbmStsDigi* in_digis, index_t* in_start_index, index_t* in_end_index, address_t* in_addresses, index_t* in_channel_split_index = nullptr, uint32_t* in_windows = nullptr, const uint32_t in_time_window = 0) : addresses_(in_addresses), timeWindow_(in_time_window), windows_(in_windows), view_(true), n_(in_n), bucketCount_(in_bucket_count), digis(in_digis), startIndex(in_start_index), endIndex(in_end_index), channelSplitIndex(in_channel_split_index) {}
+
+        CbmStsDigiBucket(const CbmStsDigiBucket&) = delete;
+        CbmStsDigiBucket& operator=(const CbmStsDigiBucket&) = delete;
+
+        /// <summary>
+        /// Buckets the next input into the bucket's own storage, reusing it. Previous contents are overwritten.
+        /// </summary>
+        void reset(const CbmStsDigiColumns& in_digis, const unsigned int threads = default_thread_count()) {
+            const page_fault_counter faults;
+            stats_ = memory_stats();
+            digis = digiStorage_.reserve(in_digis.n, stats_);
+            rebucket(in_digis, threads);
+            faults.stop(stats_);
+        }
+
+        /// <summary>
+        /// Buckets the next input into `out` (n digis, not owned). Only the indexes and the workspace are reused.
+        /// </summary>
+        void reset(const CbmStsDigiColumns& in_digis, CbmStsDigi* out, const unsigned int threads = default_thread_count()) {
+            const page_fault_counter faults;
+            stats_ = memory_stats();
+            digis = out;
+            rebucket(in_digis, threads);
+            faults.stop(stats_);
+        }
+
+        /// <summary>
+        /// Buckets the next input into the columns of `out` (SoA layout, n digis each, not owned). The bucket has the
+        /// indexes only, digis is nullptr: splitChannels and splitTimeWindows are not available.
+        /// </summary>
+        void reset(const CbmStsDigiColumns& in_digis, const CbmStsDigiSoA& out, const unsigned int threads = default_thread_count()) {
+            const page_fault_counter faults;
+            stats_ = memory_stats();
+            digis = nullptr;
+            rebucket(in_digis, out, threads);
+            faults.stop(stats_);
+        }
+
+        // Allocations and page faults of the last reset (or construction).
+        const memory_stats& stats() const { return stats_; }
+
+        /// <summary>
+        /// Filter for the following resets (not owned, nullptr to keep all digis).
+        /// </summary>
+        void setFilter(const CbmStsDigiFilter* filter) { filter_ = filter != nullptr && filter->active() ? filter : nullptr; }
+
+        /// <summary>
+        /// Accepted and rejected digis per address of the last input, in order of first appearance.
+        /// Includes addresses whose digis were all rejected (and that have no bucket).
+        /// </summary>
+        std::vector<CbmStsModuleRejections> rejections() const {
+            std::vector<CbmStsModuleRejections> result(index_.size());
+            for (count_t a = 0; a < index_.size(); a++) {
+                result[a] = CbmStsModuleRejections{index_.address(a), size_[a], rejected_[a]};
+            }
+            return result;
         }
 
-        ~CbmStsDigiBucket() {
-            delete[] digis;
-            delete[] input;
-            delete[] startIndex;
-            delete[] endIndex;
-            delete[] addresses_;
+        // Digis of the last input dropped by the filter.
+        size_t rejectedCount() const {
+            size_t sum = 0;
+            for (const count_t r : rejected_) { sum += r; }
+            return sum;
         }
 
+        /// <summary>
+        /// Moves the front side digis of each bucket before the back side ones (stable) and sets the split indexes.
+        /// For layouts that were filled from outside, e.g. decoded archives. Buckets that are split already stay as they are.
+        /// </summary>
+        void splitChannels(const unsigned int threads = default_thread_count()) {
+            channelSplitIndex = splitStorage_.reserve(bucketCount_, stats_);
+
+            pool_.run(bucketCount_, threads, [&](const size_t b) {
+                CbmStsDigi* begin = digis + startIndex[b];
+                CbmStsDigi* end = digis + endIndex[b] + 1;
+                const auto split = std::stable_partition(begin, end, [](const CbmStsDigi& d) { return d.channel < frontChannels; });
+                channelSplitIndex[b] = static_cast<index_t>(split - digis);
+            });
+            trackWorkspace();
+        }
+
+        /// <summary>
+        /// Splits every (address) bucket into one bucket per time window of `length` time units that holds digis:
+        /// the buckets are keyed by (address, time / length) afterwards. This gives large modules many independently
+        /// sortable buckets with smaller working sets.
+        ///
+        /// The windows of an address stay adjacent and in ascending order, in the original address order, so consumers
+        /// stitch them back together by walking the buckets: getAddress(i) repeats, window(i) ascends. Each window is
+        /// split by side again (channelSplitIndex), within a side the order is kept. Windows are absolute (time / length),
+        /// so they line up across inputs. Runs in O(n + windows spanned per address), to be called after each reset.
+        /// </summary>
+        void splitTimeWindows(const uint32_t length, const unsigned int threads = default_thread_count()) {
+            // Counters per bucket are dense over the windows it spans, this bounds their size.
+            constexpr uint32_t maxWindowsPerBucket = 1 << 20;
+
+            if (length == 0) { throw std::invalid_argument("Time window length must be positive"); }
+            if (view_) { throw std::logic_error("A bucket view cannot be split into time windows"); }
+            if (timeWindow_ != 0) { throw std::logic_error("Bucket is split into time windows already"); }
+            if (digis == nullptr) { throw std::logic_error("Only AoS buckets can be split into time windows"); }
+
+            const page_fault_counter faults;
+            const count_t addressBuckets = bucketCount_;
+
+            if (windowCounts_.size() < addressBuckets) { windowCounts_.resize(addressBuckets); }
+            firstWindow_.resize(addressBuckets);
+            subBucket_.resize(addressBuckets);
+            addressStart_.assign(startIndex, startIndex + addressBuckets);
+            addressOf_.assign(addresses_, addresses_ + addressBuckets);
+
+            // -----------------------------------------------------------------------------------
+            // 1. Per address bucket: windows spanned, digis per (window, side) and non-empty windows.
+            // -----------------------------------------------------------------------------------
+            pool_.run(addressBuckets, threads, [&](const size_t b) {
+                const index_t begin = startIndex[b];
+                const index_t end = endIndex[b] + 1;
+
+                uint32_t first = UINT32_MAX;
+                uint32_t last = 0;
+                for (index_t i = begin; i < end; i++) {
+                    first = std::min(first, digis[i].time / length);
+                    last = std::max(last, digis[i].time / length);
+                }
+                if (last - first >= maxWindowsPerBucket) {
+                    throw std::invalid_argument("Time window length " + std::to_string(length) + " is too small for the time range of address " + std::to_string(addresses_[b]));
+                }
+
+                std::vector<index_t>& counts = windowCounts_[b];
+                counts.assign(2 * size_t(last - first + 1), 0);
+                for (index_t i = begin; i < end; i++) {
+                    counts[2 * (digis[i].time / length - first) + (digis[i].channel >= frontChannels)]++;
+                }
+
+                count_t windows = 0;
+                for (size_t w = 0; w < counts.size(); w += 2) {
+                    windows += (counts[w] + counts[w + 1]) > 0;
+                }
+                firstWindow_[b] = first;
+                subBucket_[b] = windows;
+            });
+
+            // -----------------------------------------------------------------------------------
+            // 2. Number the new buckets: exclusive sum over the windows per address. O(addressCount)
+            // -----------------------------------------------------------------------------------
+            count_t sum = 0;
+            for (count_t b = 0; b < addressBuckets; b++) {
+                const count_t windows = subBucket_[b];
+                subBucket_[b] = sum;
+                sum += windows;
+            }
+
+            bucketCount_ = sum;
+            reserveIndexes();
+            windows_ = windowStorage_.reserve(bucketCount_, stats_);
+            CbmStsDigi* scratch = scratchStorage_.reserve(n_, stats_);
+
+            // -----------------------------------------------------------------------------------
+            // 3. Bucket table per window and stable scatter by (window, side), within each address bucket's range.
+            // -----------------------------------------------------------------------------------
+            pool_.run(addressBuckets, threads, [&](const size_t b) {
+                std::vector<index_t>& counts = windowCounts_[b];
+                const index_t begin = addressStart_[b];
+                const index_t end = b + 1 < addressBuckets ? addressStart_[b + 1] : static_cast<index_t>(n_);
+
+                index_t pos = begin;
+                count_t bucket = subBucket_[b];
+                for (size_t w = 0; w < counts.size(); w += 2) {
+                    const index_t front = counts[w];
+                    const index_t back = counts[w + 1];
+                    if (front + back == 0) { continue; }
+
+                    addresses_[bucket] = addressOf_[b];
+                    windows_[bucket] = firstWindow_[b] + static_cast<uint32_t>(w / 2);
+                    startIndex[bucket] = pos;
+                    channelSplitIndex[bucket] = pos + front;
+                    endIndex[bucket] = pos + front + back - 1;
+                    bucket++;
+
+                    counts[w] = pos;
+                    counts[w + 1] = pos + front;
+                    pos += front + back;
+                }
+
+                const uint32_t first = firstWindow_[b];
+                for (index_t i = begin; i < end; i++) {
+                    scratch[counts[2 * (digis[i].time / length - first) + (digis[i].channel >= frontChannels)]++] = digis[i];
+                }
+                std::copy(scratch + begin, scratch + end, digis + begin);
+            });
+
+            timeWindow_ = length;
+            trackWorkspace();
+            faults.stop(stats_);
+        }
+
+        // Window length, 0 if the buckets are not split by time.
+        uint32_t timeWindow() const { return timeWindow_; }
+
+        // Window index per bucket (time / timeWindow()), nullptr if the buckets are not split by time.
+        uint32_t* windows() const { return windows_; }
+
+        uint32_t window(const int i) const { return windows_ != nullptr ? windows_[i] : 0; }
+
+        // First time of the bucket's window.
+        uint64_t windowBegin(const int i) const { return uint64_t(window(i)) * timeWindow_; }
+
         CbmStsDigi& operator[](int i) { return digis[i]; }
 
         count_t size() const { return bucketCount_; }
@@ -138,68 +697,206 @@ namespace experimental {
         std::string to_index_string(index_t i) { return "(address: " + std::to_string(addresses_[i]) + ", start-idx: " + std::to_string(startIndex[i]) + ", end-idx:" + std::to_string(endIndex[i]) + ")"; }
 
     private:
+        void reserveIndexes() {
+            addresses_ = addressStorage_.reserve(bucketCount_, stats_);
+            startIndex = startStorage_.reserve(bucketCount_, stats_);
+            endIndex = endStorage_.reserve(bucketCount_, stats_);
+            channelSplitIndex = splitStorage_.reserve(bucketCount_, stats_);
+        }
+
+        void rebucket(const CbmStsDigiColumns& in_digis, const unsigned int threads) {
+            rebucket(in_digis, CbmStsDigiAoS{digis}, threads);
+        }
+
+        template<typename Layout>
+        void rebucket(const CbmStsDigiColumns& in_digis, const Layout& out, const unsigned int threads) {
+            input = in_digis;
+            timeWindow_ = 0;
+            windows_ = nullptr;
+            createBuckets(out, threads);
+
+            // The workspace grows inside the standard containers, it is counted once per container group that grew.
+            for (auto& p : parts_) {
+                const size_t bytes = p.capacity_bytes();
+                if (bytes > p.reserved) {
+                    stats_.allocations++;
+                    stats_.allocatedBytes += bytes - p.reserved;
+                    p.reserved = bytes;
+                }
+            }
+            trackWorkspace();
+        }
+
+        void trackWorkspace() {
+            size_t bytes = index_.capacity_bytes() + (size_.capacity() + frontSize_.capacity() + rejected_.capacity() + next_.capacity() + nextBack_.capacity()) * sizeof(index_t) + parts_.capacity() * sizeof(part_t);
+            bytes += windowCounts_.capacity() * sizeof(std::vector<index_t>) + (firstWindow_.capacity() + subBucket_.capacity() + addressStart_.capacity() + addressOf_.capacity()) * sizeof(uint32_t);
+            for (const auto& counts : windowCounts_) { bytes += counts.capacity() * sizeof(index_t); }
+
+            if (bytes > reserved_) {
+                stats_.allocations++;
+                stats_.allocatedBytes += bytes - reserved_;
+                reserved_ = bytes;
+            }
+
+            // One allocation per started thread (its stack is not counted in the bytes).
+            if (pool_.size() > poolThreads_) {
+                stats_.allocations += pool_.size() - poolThreads_;
+                poolThreads_ = pool_.size();
+            }
+        }
+
         /// <summary>
-        /// Running time: O(n) = 2*O(n) + 2*O(addressCount) = O(n) + O(1) = O(n)
+        /// Running time: O(n) = 2*O(n) + O(parts * addressCount) = O(n), spread over `threads` threads.
+        ///
+        /// The input is cut into one contiguous part per thread. Each part counts its addresses in a private index
+        /// (numbered in the part's own first-appearance order). Walking the parts in input order and their addresses in
+        /// that local order visits every address first where it first appears globally, so merging the local indexes
+        /// in this order yields exactly the serial bucket order. Each part then scatters into its own, disjoint slices
+        /// of every bucket (one per side), after the slices of all earlier parts: the digis keep their input order within
+        /// each side of a bucket and the layout is identical for any thread count.
+        ///
+        /// A filter is applied in the count (only accepted digis are counted) and again in the scatter (rejected digis
+        /// are skipped), the decision is the same both times. Afterwards n_ is the number of accepted digis.
+        ///
+        /// The scatter writes through the layout policy (CbmStsDigiAoS or CbmStsDigiSoA), everything else is the same.
         /// </summary>
-        void createBuckets() {
-           // -----------------------------------------------------------------------------------
-            // 1. Init to zero and count all addresses. This will determine the output layout.
+        template<typename Layout>
+        void createBuckets(const Layout& out, const unsigned int threads) {
+            // Below this many digis per part, starting a thread costs more than it saves.
+            constexpr size_t minDigisPerPart = 1 << 16;
+
+            const size_t inputN = input.n;
+            const size_t parts = std::max<size_t>(1, std::min<size_t>(std::max(threads, 1u), inputN / minDigisPerPart));
+            const size_t step = (inputN + parts - 1) / parts;
+
+            if (parts_.size() < parts) { parts_.resize(parts); }
+            for (size_t t = 0; t < parts; t++) {
+                parts_[t].clear();
+                parts_[t].begin = std::min(t * step, inputN);
+                parts_[t].end = std::min(parts_[t].begin + step, inputN);
+            }
+
+            const CbmStsDigiFilter* filter = filter_;
+            auto accepts = [&](const part_t& p, const count_t b, const size_t i) {
+                return filter == nullptr || filter->accepts(p.mask[b], input.channel[i], input.charge[i]);
+            };
+
+            // -----------------------------------------------------------------------------------
+            // 1. Count all addresses per part. This will determine the output layout.
             //    Each address bucket's size in the flat array is determined by each address count.
             // -----------------------------------------------------------------------------------
-            for (int i = 0; i < n_; i++) {
-                // Init map entries.
-                if (addressCounter.find(input[i].address) == addressCounter.end()) {
-                    addressCounter[input[i].address] = 0;
-                    addressStartIndex[input[i].address] = 0;
-
-                    // Just take the addresses just in the order they first appear to use them as buckets.
-                    addressOrder.push_back(input[i].address);
+            pool_.run(parts, threads, [&](const size_t t) {
+                part_t& p = parts_[t];
+                for (size_t i = p.begin; i < p.end; i++) {
+                    const count_t b = p.index.insert(input.address[i]);
+                    if (b == p.counter.size()) {
+                        p.counter.push_back(0);
+                        p.frontCounter.push_back(0);
+                        p.rejected.push_back(0);
+                        p.mask.push_back(filter != nullptr ? filter->channelMask(input.address[i]) : nullptr);
+                    }
+                    if (!accepts(p, b, i)) {
+                        p.rejected[b]++;
+                        continue;
+                    }
+                    p.counter[b]++;
+                    p.frontCounter[b] += input.channel[i] < frontChannels;
                 }
+            });
 
-                addressCounter[input[i].address]++;
+            // -----------------------------------------------------------------------------------
+            // 2. Merge the local indexes in first-appearance order, bucket sizes. O(parts * addressCount) -> small.
+            // -----------------------------------------------------------------------------------
+            index_.clear();
+            size_.clear();
+            frontSize_.clear();
+            rejected_.clear();
+
+            for (size_t t = 0; t < parts; t++) {
+                part_t& p = parts_[t];
+                p.bucket.resize(p.index.size());
+                for (count_t b = 0; b < p.index.size(); b++) {
+                    p.bucket[b] = index_.insert(p.index.address(b));
+                    if (p.bucket[b] == size_.size()) {
+                        size_.push_back(0);
+                        frontSize_.push_back(0);
+                        rejected_.push_back(0);
+                    }
+                    size_[p.bucket[b]] += p.counter[b];
+                    frontSize_[p.bucket[b]] += p.frontCounter[b];
+                    rejected_[p.bucket[b]] += p.rejected[b];
+                }
             }
 
             // -----------------------------------------------------------------------------------
-            // 2. Excluside sum per address. O(addressOrder.size()) -> small.
+            // 3. Exclusive sum per address, start, split and end indexes, and each part's slices per bucket.
+            //    Addresses without accepted digis get no bucket.
             // -----------------------------------------------------------------------------------
-            count_t sum = 0;
-            // The address of the first element is = 0.
-            for (int i = 0; i < addressOrder.size(); i++) {
-                const address_t address = addressOrder[i];
-
-                addressStartIndex[address] = sum;
-                sum += addressCounter[address];
+            const count_t addressCount = index_.size();
+            bucketCount_ = static_cast<count_t>(addressCount - std::count(size_.begin(), size_.end(), 0));
+            reserveIndexes();
+
+            next_.resize(addressCount);
+            nextBack_.resize(addressCount);
+
+            index_t sum = 0;
+            count_t bucket = 0;
+            for (count_t a = 0; a < addressCount; a++) {
+                next_[a] = sum;
+                nextBack_[a] = sum + frontSize_[a];
+                if (size_[a] == 0) { continue; }
+
+                addresses_[bucket] = index_.address(a);
+                startIndex[bucket] = sum;
+                channelSplitIndex[bucket] = sum + frontSize_[a];
+                endIndex[bucket] = sum + size_[a] - 1;
+                sum += size_[a];
+                bucket++;
+            }
+            n_ = sum;
+
+            for (size_t t = 0; t < parts; t++) {
+                part_t& p = parts_[t];
+                p.offset.resize(p.bucket.size());
+                p.backOffset.resize(p.bucket.size());
+                for (count_t b = 0; b < p.bucket.size(); b++) {
+                    p.offset[b] = next_[p.bucket[b]];
+                    p.backOffset[b] = nextBack_[p.bucket[b]];
+                    next_[p.bucket[b]] += p.frontCounter[b];
+                    nextBack_[p.bucket[b]] += p.counter[b] - p.frontCounter[b];
+                }
             }
 
             // -----------------------------------------------------------------------------------
-            // 3. Compute start and end indexes: O(addressOrder.size()) -> small.
+            // 4. Place in virtual buckets in the flat array. The parts write disjoint slices.
             // -----------------------------------------------------------------------------------
-            addresses_ = new address_t[addressOrder.size()];
+            pool_.run(parts, threads, [&](const size_t t) {
+                part_t& p = parts_[t];
+                for (size_t i = p.begin; i < p.end; i++) {
+                    const count_t b = p.index.find(input.address[i]);
+                    if (!accepts(p, b, i)) { continue; }
+                    index_t& pos = input.channel[i] < frontChannels ? p.offset[b] : p.backOffset[b];
+                    // If the DEBUG_SORT symbol is not defined, the address in the CbmStsDigi constructor is ignored and not part of the type.
+                    out.set(pos++, input.digi(i));
+                }
+            });
+        }
+    };
 
-            startIndex = new index_t[addressOrder.size()];
-            endIndex = new index_t[addressOrder.size()];
+    /// <summary>
+    /// What the benchmarks consume: either the raw input columns, which every benchmark buckets itself,
+    /// or a bucket that was already built by the loader (archive input), which all benchmarks share.
+    /// </summary>
+    struct CbmStsDigiSource {
+        CbmStsDigiColumns columns;
 
-            bucketCount_ = addressOrder.size();
+        // Not owned, used instead of the columns if set.
+        const CbmStsDigiBucket* bucket = nullptr;
 
-            // Traverse alln
-            for (int i = 0; i < addressOrder.size(); i++) {
-                addresses_[i] = addressOrder[i];
-                startIndex[i] = addressStartIndex[addressOrder[i]];
-                endIndex[i] = startIndex[i] + addressCounter[addressOrder[i]] - 1;
-                // Debug bucket indexes
-                // std::cout << addresses_[i] << ", " << startIndex[i] << ", " << endIndex[i] << "\n";
-            }
+        CbmStsDigiSource(const CbmStsDigiColumns& in_columns) : columns(in_columns) {}
+        CbmStsDigiSource(const CbmStsDigiBucket* in_bucket) : bucket(in_bucket) {}
 
-            // -----------------------------------------------------------------------------------
-            // 4. Place in virtual buckets in the flat array.
-            // Copy elements to the right location
-            // -----------------------------------------------------------------------------------
-            for (int i = 0; i < n_; i++) {
-                // All digis on the back-side (>= 1024) are offset by the number of front-side digis in the bucket (<= 1023).
-                // If the DEBUG_SORT symbol is not defined, the address in the CbmStsDigi constructor is ignored and not part of the type.
-                digis[addressStartIndex[input[i].address]++] = CbmStsDigi(input[i].channel, input[i].time, input[i].charge);
-            }
-        }
+        size_t size() const { return bucket != nullptr ? bucket->n() : columns.n; }
     };
 }
 
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "datastructures.h"
+#include "parallel.h"
+#include "io/binary.h"
+#include "io/writer.h"
+
+namespace experimental {
+
+    enum class digi_profile {
+        // Everything as learned from the input.
+        realistic,
+        // One module receives hotFraction of all digis.
+        hot_module,
+        // Every digi is on the same channel.
+        one_channel,
+        // Channels are uniform over the whole sensor side.
+        uniform_channels,
+        // moduleCount synthetic modules with equal, small occupancy.
+        tiny_modules
+    };
+
+    inline digi_profile parse_profile(const std::string& name) {
+        if (name == "realistic") return digi_profile::realistic;
+        if (name == "hot-module") return digi_profile::hot_module;
+        if (name == "one-channel") return digi_profile::one_channel;
+        if (name == "uniform") return digi_profile::uniform_channels;
+        if (name == "tiny-modules") return digi_profile::tiny_modules;
+        throw std::invalid_argument("Unknown profile: " + name + " (realistic, hot-module, one-channel, uniform, tiny-modules)");
+    }
+
+    /// <summary>
+    /// Samples from a fixed discrete distribution: cumulative weights and a binary search.
+    /// Unlike std::discrete_distribution it is const, so one sampler is shared by all generator threads.
+    /// </summary>
+    template<typename T>
+    class discrete_sampler {
+        std::vector<T> values;
+        std::vector<double> cumulative;
+
+    public:
+        discrete_sampler() = default;
+
+        discrete_sampler(const std::vector<T>& in_values, const std::vector<double>& weights) : values(in_values), cumulative(weights.size()) {
+            if (values.empty() || values.size() != weights.size()) {
+                throw std::invalid_argument("Sampler needs one weight per value");
+            }
+            std::partial_sum(weights.begin(), weights.end(), cumulative.begin());
+        }
+
+        static discrete_sampler from_counts(const std::map<T, size_t>& counts) {
+            std::vector<T> values;
+            std::vector<double> weights;
+            for (const auto& c : counts) {
+                values.push_back(c.first);
+                weights.push_back(static_cast<double>(c.second));
+            }
+            return discrete_sampler(values, weights);
+        }
+
+        template<typename Rng>
+        T operator()(Rng& rng) const {
+            const double u = std::uniform_real_distribution<double>(0, cumulative.back())(rng);
+            const size_t i = std::upper_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+            return values[std::min(i, values.size() - 1)];
+        }
+    };
+
+    /// <summary>
+    /// Statistical model of a timeslice: occupancy per address, channel distribution per address,
+    /// distribution of the time gaps between consecutive digis (in time order) and the charge distribution.
+    /// Addresses share channel samplers by index, so profiles with thousands of modules stay small.
+    /// </summary>
+    struct digi_model {
+        // Channels of one sensor side.
+        static constexpr unsigned short channelCount = 2048;
+
+        std::vector<address_t> addresses;
+        std::vector<double> occupancy;
+        std::vector<size_t> channelSampler;
+
+        std::vector<discrete_sampler<unsigned short>> channelSamplers;
+        discrete_sampler<unsigned int> gaps;
+        discrete_sampler<unsigned short> charges;
+
+        size_t size() const { return addresses.size(); }
+    };
+
+    /// <summary>
+    /// Address of a module from its position in the STS (bit field version 1, see device.h).
+    /// </summary>
+    inline address_t make_sts_address(const unsigned int unit, const unsigned int ladder, const unsigned int halfLadder, const unsigned int module) {
+        // Version 1, system kSts.
+        constexpr uint32_t base = (1u << 28) | 2u;
+        return static_cast<address_t>(base | (unit << 4) | (ladder << 10) | (halfLadder << 15) | (module << 16));
+    }
+
+    /// <summary>
+    /// Learns the model from a timeslice. The input does not have to be time ordered.
+    /// </summary>
+    digi_model learn_model(const CbmStsDigiColumns& digis) {
+        if (digis.n == 0) {
+            throw std::invalid_argument("Cannot learn a model from an empty input");
+        }
+
+        std::map<address_t, size_t> addressIndex;
+        std::vector<std::map<unsigned short, size_t>> channels;
+        std::map<unsigned short, size_t> charges;
+
+        digi_model model;
+
+        for (size_t i = 0; i < digis.n; i++) {
+            auto it = addressIndex.find(digis.address[i]);
+            if (it == addressIndex.end()) {
+                it = addressIndex.emplace(digis.address[i], model.addresses.size()).first;
+                model.addresses.push_back(digis.address[i]);
+                model.occupancy.push_back(0);
+                channels.emplace_back();
+            }
+
+            model.occupancy[it->second]++;
+            channels[it->second][digis.channel[i]]++;
+            charges[digis.charge[i]]++;
+        }
+
+        for (size_t a = 0; a < model.size(); a++) {
+            model.channelSampler.push_back(a);
+            model.channelSamplers.push_back(discrete_sampler<unsigned short>::from_counts(channels[a]));
+        }
+        model.charges = discrete_sampler<unsigned short>::from_counts(charges);
+
+        std::vector<unsigned int> times(digis.time, digis.time + digis.n);
+        std::sort(times.begin(), times.end());
+
+        std::map<unsigned int, size_t> gaps;
+        for (size_t i = 1; i < times.size(); i++) {
+            gaps[times[i] - times[i - 1]]++;
+        }
+        // A single digi has no gap, it gets a timeslice of constant time.
+        if (times.size() == 1) { gaps[0] = 1; }
+        model.gaps = discrete_sampler<unsigned int>::from_counts(gaps);
+
+        return model;
+    }
+
+    /// <summary>
+    /// Turns a learned model into one of the adversarial profiles. Time and charge distributions are kept.
+    /// </summary>
+    void apply_profile(digi_model& model, const digi_profile profile, const double hotFraction = 0.9, const size_t moduleCount = 10000) {
+        std::vector<unsigned short> uniformChannels(digi_model::channelCount);
+        std::iota(uniformChannels.begin(), uniformChannels.end(), 0);
+        const std::vector<double> uniformWeights(digi_model::channelCount, 1.0);
+
+        switch (profile) {
+            case digi_profile::realistic:
+                break;
+
+            case digi_profile::hot_module: {
+                if (hotFraction <= 0 || hotFraction >= 1) {
+                    throw std::invalid_argument("Hot module fraction must be in (0, 1)");
+                }
+                // The already busiest module gets hotFraction of all digis, the others keep their ratios.
+                const size_t hot = std::max_element(model.occupancy.begin(), model.occupancy.end()) - model.occupancy.begin();
+                const double others = std::accumulate(model.occupancy.begin(), model.occupancy.end(), 0.0) - model.occupancy[hot];
+                model.occupancy[hot] = others > 0 ? others * hotFraction / (1 - hotFraction) : 1;
+                break;
+            }
+
+            case digi_profile::one_channel:
+                model.channelSamplers = {discrete_sampler<unsigned short>({0}, {1.0})};
+                std::fill(model.channelSampler.begin(), model.channelSampler.end(), 0);
+                break;
+
+            case digi_profile::uniform_channels:
+                model.channelSamplers = {discrete_sampler<unsigned short>(uniformChannels, uniformWeights)};
+                std::fill(model.channelSampler.begin(), model.channelSampler.end(), 0);
+                break;
+
+            case digi_profile::tiny_modules: {
+                // Units, ladders, half-ladders and modules span 2^17 distinct modules.
+                constexpr size_t maxModules = 64 * 32 * 2 * 32;
+                if (moduleCount == 0 || moduleCount > maxModules) {
+                    throw std::invalid_argument("Module count must be in [1, " + std::to_string(maxModules) + "]");
+                }
+
+                model.addresses.clear();
+                for (size_t m = 0; m < moduleCount; m++) {
+                    model.addresses.push_back(make_sts_address(m % 64, (m / 64) % 32, (m / 2048) % 2, m / 4096));
+                }
+                model.occupancy.assign(moduleCount, 1.0);
+                model.channelSampler.assign(moduleCount, 0);
+                model.channelSamplers = {discrete_sampler<unsigned short>(uniformChannels, uniformWeights)};
+                break;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Synthesizes n digis from the model and streams them into a binary digi file (see io/binary.h).
+    ///
+    /// Time progresses monotonically: each digi follows its predecessor by a gap drawn from the model, so
+    /// larger timeslices are longer, not denser. The digis are generated in chunks, each from its own
+    /// seeded generator and with times relative to the chunk start. The chunks of a batch are generated
+    /// in parallel, then shifted by the time the previous chunks took and written to their place in each
+    /// column. Memory is bounded by one batch, the output only depends on the model, n and the seed.
+    /// </summary>
+    void generateBinary(const std::string& filename, const digi_model& model, const size_t n, const uint64_t seed = 42, const unsigned int threads = default_thread_count()) {
+        constexpr size_t chunkSize = 1 << 20;
+
+        struct chunk_t {
+            std::vector<address_t> address;
+            std::vector<unsigned short> channel;
+            std::vector<unsigned int> time;
+            std::vector<unsigned short> charge;
+            // Time from the chunk start to its last digi.
+            uint64_t duration = 0;
+        };
+
+        const discrete_sampler<size_t> modules = [&] {
+            std::vector<size_t> indices(model.size());
+            std::iota(indices.begin(), indices.end(), 0);
+            return discrete_sampler<size_t>(indices, model.occupancy);
+        }();
+
+        const CbmStsDigiFileHeader header = binary::make_header(n);
+        const size_t chunks = (n + chunkSize - 1) / chunkSize;
+        const size_t batchSize = std::max(threads, 1u);
+
+        std::vector<chunk_t> batch(std::min(batchSize, chunks));
+        uint64_t time = 0;
+
+        const int fd = writer::open_output(filename);
+        try {
+            writer::pwrite_all(fd, &header, sizeof(header), 0);
+
+            for (size_t first = 0; first < chunks; first += batchSize) {
+                const size_t count = std::min(batchSize, chunks - first);
+
+                // -----------------------------------------------------------------------------------
+                // 1. Generate the chunks of this batch in parallel.
+                // -----------------------------------------------------------------------------------
+                parallel_for(count, threads, [&](const size_t b) {
+                    const size_t c = first + b;
+                    const size_t size = std::min(chunkSize, n - c * chunkSize);
+
+                    std::seed_seq seq{seed, static_cast<uint64_t>(c)};
+                    std::mt19937_64 rng(seq);
+
+                    chunk_t& chunk = batch[b];
+                    chunk.address.resize(size);
+                    chunk.channel.resize(size);
+                    chunk.time.resize(size);
+                    chunk.charge.resize(size);
+
+                    // The first digi of a chunk also has a gap, to the last digi of the previous chunk.
+                    uint64_t t = 0;
+                    for (size_t i = 0; i < size; i++) {
+                        t += model.gaps(rng);
+                        const size_t m = modules(rng);
+
+                        chunk.address[i] = model.addresses[m];
+                        chunk.channel[i] = model.channelSamplers[model.channelSampler[m]](rng);
+                        chunk.time[i] = static_cast<unsigned int>(t);
+                        chunk.charge[i] = model.charges(rng);
+                    }
+                    chunk.duration = t;
+                });
+
+                // -----------------------------------------------------------------------------------
+                // 2. Shift to absolute times in chunk order and write each column slice.
+                // -----------------------------------------------------------------------------------
+                for (size_t b = 0; b < count; b++) {
+                    if (time + batch[b].duration > std::numeric_limits<unsigned int>::max()) {
+                        throw std::runtime_error("Timeslice exceeds the 32 bit time range after " + std::to_string((first + b) * chunkSize) + " digis");
+                    }
+                    const unsigned int offset = static_cast<unsigned int>(time);
+                    for (auto& t : batch[b].time) { t += offset; }
+                    time += batch[b].duration;
+                }
+
+                parallel_for(count, threads, [&](const size_t b) {
+                    const chunk_t& chunk = batch[b];
+                    const uint64_t row = (first + b) * chunkSize;
+                    const size_t size = chunk.time.size();
+
+                    writer::pwrite_all(fd, chunk.address.data(), size * sizeof(address_t), header.addressOffset + row * sizeof(address_t));
+                    writer::pwrite_all(fd, chunk.channel.data(), size * sizeof(unsigned short), header.channelOffset + row * sizeof(unsigned short));
+                    writer::pwrite_all(fd, chunk.time.data(), size * sizeof(unsigned int), header.timeOffset + row * sizeof(unsigned int));
+                    writer::pwrite_all(fd, chunk.charge.data(), size * sizeof(unsigned short), header.chargeOffset + row * sizeof(unsigned short));
+                });
+            }
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include "mapped_file.h"
+#include "../parallel.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    // +--------+-------------------------------------------+------------------------------------------+
+    // | Header | Bucket table: address, count, offset  [b] | Bucket payloads: per digi varint encoded  |
+    // +--------+-------------------------------------------+------------------------------------------+
+    //
+    // The digis are stored grouped by address, in the same bucket and digi order CbmStsDigiBucket produces.
+    // Per digi: zigzag delta of the channel, zigzag delta of the time (both relative to the previous digi
+    // of the bucket) and the charge, each as LEB128 varint. Clustered channels and time ordered input
+    // make most fields a single byte. Deltas and varints are 64 bit: the time delta of a bucket's first digi (relative
+    // to 0) covers the whole unsigned int range.
+    //
+    // Version 2: 64 bit deltas. Version 1 truncated time deltas of 2^31 and more.
+    constexpr char archiveMagic[8] = {'S', 'T', 'S', 'D', 'I', 'G', 'Z', '\0'};
+    constexpr uint32_t archiveVersion = 2;
+
+    struct CbmStsDigiArchiveHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t n;
+        uint64_t bucketCount;
+    };
+
+    struct CbmStsDigiArchiveBucket {
+        int32_t address;
+        uint32_t count;
+        // Byte offset of the payload from the beginning of the file.
+        uint64_t offset;
+    };
+
+    namespace archive {
+
+        inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        // Reads one varint from [p, end), nullptr if it runs past end or is longer than 64 bits.
+        inline const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, uint64_t& value) {
+            uint64_t result = 0;
+            unsigned int shift = 0;
+
+            while (p < end && shift < 64) {
+                const uint8_t byte = *p++;
+                result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                shift += 7;
+
+                if ((byte & 0x80) == 0) {
+                    value = result;
+                    return p;
+                }
+            }
+            return nullptr;
+        }
+
+        inline uint64_t zigzag(const int64_t delta) { return (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63); }
+
+        inline int64_t unzigzag(const uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+        inline void encode_bucket(const CbmStsDigi* begin, const CbmStsDigi* end, std::vector<uint8_t>& out) {
+            int64_t channel = 0;
+            int64_t time = 0;
+
+            for (const CbmStsDigi* d = begin; d != end; d++) {
+                put_varint(out, zigzag(int64_t(d->channel) - channel));
+                put_varint(out, zigzag(int64_t(d->time) - time));
+                put_varint(out, d->charge);
+
+                channel = d->channel;
+                time = d->time;
+            }
+        }
+
+        // Decodes count digis from the payload [p, end), false if the payload ends early.
+        inline bool decode_bucket(const uint8_t* p, const uint8_t* end, CbmStsDigi* out, const uint32_t count) {
+            int64_t channel = 0;
+            int64_t time = 0;
+            uint64_t value;
+
+            for (uint32_t i = 0; i < count; i++) {
+                if ((p = get_varint(p, end, value)) == nullptr) { return false; }
+                channel += unzigzag(value);
+                if ((p = get_varint(p, end, value)) == nullptr) { return false; }
+                time += unzigzag(value);
+                if ((p = get_varint(p, end, value)) == nullptr) { return false; }
+
+                out[i] = CbmStsDigi(static_cast<unsigned short>(channel), static_cast<unsigned int>(time), static_cast<unsigned short>(value));
+            }
+            return true;
+        }
+
+    } // namespace archive
+
+    inline bool is_archive_input(const std::string& filename) {
+        const std::string ext = ".dza";
+        return filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+    }
+
+    void writeArchive(const std::string filename, const CbmStsDigiBucket& bucket, const unsigned int threads = default_thread_count()) {
+        std::vector<std::vector<uint8_t>> payloads(bucket.size());
+
+        parallel_for(bucket.size(), threads, [&](const size_t i) {
+            archive::encode_bucket(bucket.digis + bucket.begin(i), bucket.digis + bucket.end(i) + 1, payloads[i]);
+        });
+
+        CbmStsDigiArchiveHeader header{};
+        std::memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+        header.version = archiveVersion;
+        header.headerSize = sizeof(CbmStsDigiArchiveHeader);
+        header.n = bucket.n();
+        header.bucketCount = bucket.size();
+
+        std::vector<CbmStsDigiArchiveBucket> table(bucket.size());
+        uint64_t offset = sizeof(header) + table.size() * sizeof(CbmStsDigiArchiveBucket);
+        for (count_t i = 0; i < bucket.size(); i++) {
+            table[i] = CbmStsDigiArchiveBucket{bucket.getAddress(i), bucket.end(i) - bucket.begin(i) + 1, offset};
+            offset += payloads[i].size();
+        }
+
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("File: " + filename + " cannot be written");
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CbmStsDigiArchiveBucket));
+        for (const auto& payload : payloads) {
+            file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+        }
+
+        if (!file.good()) {
+            throw std::runtime_error("File: " + filename + " write failed");
+        }
+    }
+
+    /// <summary>
+    /// Decodes an archive straight into the flat bucket layout. The bucket table already contains every
+    /// bucket's size, so start/end indexes follow from one exclusive sum over the (few) buckets and each
+    /// bucket is decoded in parallel into its final place. No counting or scatter pass over the digis.
+    /// The returned bucket is owned by the caller. The table and every payload are checked against the file size,
+    /// a truncated or corrupt archive throws.
+    /// </summary>
+    CbmStsDigiBucket* readArchive(const std::string filename, const unsigned int threads = default_thread_count()) {
+        const mapped_file file(filename);
+        const auto* header = reinterpret_cast<const CbmStsDigiArchiveHeader*>(file.data());
+
+        if (file.size() < sizeof(CbmStsDigiArchiveHeader) || std::memcmp(header->magic, archiveMagic, sizeof(archiveMagic)) != 0) {
+            throw std::runtime_error("File: " + filename + " is not a digi archive");
+        }
+        if (header->version != archiveVersion) {
+            throw std::runtime_error("File: " + filename + " has unsupported version " + std::to_string(header->version));
+        }
+        if (header->headerSize < sizeof(CbmStsDigiArchiveHeader) || header->headerSize > file.size()
+            || header->bucketCount > (file.size() - header->headerSize) / sizeof(CbmStsDigiArchiveBucket)) {
+            throw std::runtime_error("File: " + filename + " is truncated");
+        }
+
+        const auto* table = reinterpret_cast<const CbmStsDigiArchiveBucket*>(file.data() + header->headerSize);
+        const uint64_t payloadBegin = header->headerSize + header->bucketCount * sizeof(CbmStsDigiArchiveBucket);
+
+        // Payloads follow the table back to back: each one ends where the next begins, the last at the end of the file.
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < header->bucketCount; i++) {
+            const uint64_t begin = table[i].offset;
+            const uint64_t end = i + 1 < header->bucketCount ? table[i + 1].offset : file.size();
+            if (begin < payloadBegin || begin > end || end > file.size()) {
+                throw std::runtime_error("File: " + filename + " has an invalid payload offset in bucket " + std::to_string(i));
+            }
+            sum += table[i].count;
+        }
+
+        if (sum != header->n) {
+            throw std::runtime_error("File: " + filename + " has an inconsistent bucket table");
+        }
+
+        std::unique_ptr<CbmStsDigiBucket> bucket(new CbmStsDigiBucket(header->n, header->bucketCount));
+
+        index_t start = 0;
+        for (uint64_t i = 0; i < header->bucketCount; i++) {
+            bucket->address()[i] = table[i].address;
+            bucket->startIndex[i] = start;
+            bucket->endIndex[i] = start + table[i].count - 1;
+            start += table[i].count;
+        }
+
+        parallel_for(header->bucketCount, threads, [&](const size_t i) {
+            const auto* data = reinterpret_cast<const uint8_t*>(file.data());
+            const uint64_t end = i + 1 < header->bucketCount ? table[i + 1].offset : file.size();
+            if (!archive::decode_bucket(data + table[i].offset, data + end, bucket->digis + bucket->startIndex[i], table[i].count)) {
+                throw std::runtime_error("File: " + filename + " has a truncated payload in bucket " + std::to_string(i));
+            }
+        });
+
+        // Archives written before buckets were split by side are split here.
+        bucket->splitChannels(threads);
+
+        return bucket.release();
+    }
+
+}
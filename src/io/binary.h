@@ -0,0 +1,147 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include "mapped_file.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    // +----------------------------------------------------------------------------+
+    // | Header | address (int32)[n] | channel (uint16)[n] | time (uint32)[n] | charge (uint16)[n] |
+    // +----------------------------------------------------------------------------+
+    // Every column starts at a multiple of binaryColumnAlignment, so the mapped columns
+    // can be used in place (the mapping itself is page aligned).
+    constexpr char binaryMagic[8] = {'S', 'T', 'S', 'D', 'I', 'G', 'I', '\0'};
+    constexpr uint32_t binaryVersion = 1;
+    constexpr uint64_t binaryColumnAlignment = 64;
+
+    struct CbmStsDigiFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;
+        uint64_t n;
+
+        // Byte offsets from the beginning of the file.
+        uint64_t addressOffset;
+        uint64_t channelOffset;
+        uint64_t timeOffset;
+        uint64_t chargeOffset;
+    };
+
+    namespace binary {
+
+        inline uint64_t align(const uint64_t offset) {
+            return (offset + binaryColumnAlignment - 1) / binaryColumnAlignment * binaryColumnAlignment;
+        }
+
+        inline CbmStsDigiFileHeader make_header(const uint64_t n) {
+            CbmStsDigiFileHeader header{};
+            std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+            header.version = binaryVersion;
+            header.headerSize = sizeof(CbmStsDigiFileHeader);
+            header.n = n;
+
+            header.addressOffset = align(sizeof(CbmStsDigiFileHeader));
+            header.channelOffset = align(header.addressOffset + n * sizeof(address_t));
+            header.timeOffset = align(header.channelOffset + n * sizeof(unsigned short));
+            header.chargeOffset = align(header.timeOffset + n * sizeof(unsigned int));
+
+            return header;
+        }
+
+        inline void write_column(std::ofstream& file, const uint64_t offset, const void* data, const size_t bytes) {
+            static const char zeros[binaryColumnAlignment] = {};
+            const uint64_t pos = file.tellp();
+            file.write(zeros, offset - pos);
+            file.write(static_cast<const char*>(data), bytes);
+        }
+
+    } // namespace binary
+
+    inline bool is_binary_input(const std::string& filename) {
+        const std::string ext = ".bin";
+        return filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+    }
+
+    void writeBinary(const std::string filename, const CbmStsDigiColumns& digis) {
+        std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("File: " + filename + " cannot be written");
+        }
+
+        const CbmStsDigiFileHeader header = binary::make_header(digis.n);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        binary::write_column(file, header.addressOffset, digis.address, digis.n * sizeof(address_t));
+        binary::write_column(file, header.channelOffset, digis.channel, digis.n * sizeof(unsigned short));
+        binary::write_column(file, header.timeOffset, digis.time, digis.n * sizeof(unsigned int));
+        binary::write_column(file, header.chargeOffset, digis.charge, digis.n * sizeof(unsigned short));
+
+        if (!file.good()) {
+            throw std::runtime_error("File: " + filename + " write failed");
+        }
+    }
+
+    /// <summary>
+    /// Memory mapped binary digi file. The columns are used in place, nothing is parsed or copied,
+    /// so the pages are only read when a consumer touches them.
+    /// </summary>
+    class CbmStsDigiBinaryFile {
+        mapped_file file;
+        const CbmStsDigiFileHeader* header;
+
+    public:
+        explicit CbmStsDigiBinaryFile(const std::string& filename) : file(filename) {
+            if (file.size() < sizeof(CbmStsDigiFileHeader)) {
+                throw std::runtime_error("File: " + filename + " is not a binary digi file");
+            }
+
+            header = reinterpret_cast<const CbmStsDigiFileHeader*>(file.data());
+
+            if (std::memcmp(header->magic, binaryMagic, sizeof(binaryMagic)) != 0) {
+                throw std::runtime_error("File: " + filename + " is not a binary digi file");
+            }
+            if (header->version != binaryVersion) {
+                throw std::runtime_error("File: " + filename + " has unsupported version " + std::to_string(header->version));
+            }
+            if (header->chargeOffset + header->n * sizeof(unsigned short) > file.size()) {
+                throw std::runtime_error("File: " + filename + " is truncated");
+            }
+        }
+
+        size_t size() const { return header->n; }
+
+        CbmStsDigiColumns columns() const {
+            return CbmStsDigiColumns{
+                reinterpret_cast<const address_t*>(file.data() + header->addressOffset),
+                reinterpret_cast<const unsigned short*>(file.data() + header->channelOffset),
+                reinterpret_cast<const unsigned int*>(file.data() + header->timeOffset),
+                reinterpret_cast<const unsigned short*>(file.data() + header->chargeOffset),
+                header->n
+            };
+        }
+
+        /// <summary>
+        /// Drops the resident pages of rows [from, to) of every column, see mapped_file::release. The page holding row
+        /// from is dropped too, as the rows before it are consumed as well; it faults back in if still read.
+        /// </summary>
+        void release(const size_t from, const size_t to) const {
+            release_column(header->addressOffset, sizeof(address_t), from, to);
+            release_column(header->channelOffset, sizeof(unsigned short), from, to);
+            release_column(header->timeOffset, sizeof(unsigned int), from, to);
+            release_column(header->chargeOffset, sizeof(unsigned short), from, to);
+        }
+
+    private:
+        void release_column(const uint64_t offset, const size_t width, const size_t from, const size_t to) const {
+            const size_t page = ::sysconf(_SC_PAGESIZE);
+            file.release(file.data() + (offset + from * width) / page * page, file.data() + offset + to * width);
+        }
+    };
+
+}
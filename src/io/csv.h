@@ -0,0 +1,269 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "mapped_file.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    // address,system,unit,ladder,half-ladder,module,sensor,side,channel,time,charge
+    constexpr unsigned int csvColumnCount = 11;
+
+    namespace csv {
+
+        /// <summary>
+        /// Number of leading ASCII digits in the 8 bytes of chunk (first character in the lowest byte).
+        /// A byte is a digit iff (byte ^ '0') <= 9. Adding 0x76 sets the high bit for every value >= 10.
+        /// Carries only run towards higher bytes, so the first non-digit is always detected exactly.
+        /// </summary>
+        inline unsigned int digit_count(const uint64_t chunk) {
+            const uint64_t t = chunk ^ 0x3030303030303030ULL;
+            const uint64_t nonDigit = ((t + 0x7676767676767676ULL) | t) & 0x8080808080808080ULL;
+
+            return nonDigit == 0 ? 8 : __builtin_ctzll(nonDigit) >> 3;
+        }
+
+        /// <summary>
+        /// Converts the first k (1..8) digits of chunk in a few multiplications (SWAR).
+        /// The digits are shifted to the top so the lower bytes act as leading zeros.
+        /// </summary>
+        inline uint32_t convert_digits(uint64_t chunk, const unsigned int k) {
+            chunk -= 0x3030303030303030ULL;
+            chunk <<= 8 * (8 - k);
+
+            chunk = (chunk * 10) + (chunk >> 8);
+            chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                    (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+
+            return static_cast<uint32_t>(chunk);
+        }
+
+        /// <summary>
+        /// Parses an optionally negative decimal integer starting at p. Returns the first character after the number.
+        /// Uses an 8 byte SWAR step whenever 8 bytes can be read without leaving [p, end).
+        /// </summary>
+        inline const char* parse_int(const char* p, const char* end, int& out) {
+            bool negative = false;
+            if (p < end && *p == '-') {
+                negative = true;
+                p++;
+            }
+
+            int64_t value = 0;
+
+            if (end - p >= 8) {
+                uint64_t chunk;
+                std::memcpy(&chunk, p, sizeof(chunk));
+
+                const unsigned int k = digit_count(chunk);
+                if (k > 0) {
+                    value = convert_digits(chunk, k);
+                }
+                p += k;
+
+                // More than 8 digits (e.g. addresses) continue with the scalar loop.
+                if (k < 8) {
+                    out = static_cast<int>(negative ? -value : value);
+                    return p;
+                }
+            }
+
+            while (p < end && static_cast<unsigned char>(*p - '0') <= 9) {
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+
+            out = static_cast<int>(negative ? -value : value);
+            return p;
+        }
+
+        /// <summary>
+        /// Returns the start of the line following p, or end.
+        /// </summary>
+        inline const char* next_line(const char* p, const char* end) {
+            const void* nl = std::memchr(p, '\n', end - p);
+            return nl == nullptr ? end : static_cast<const char*>(nl) + 1;
+        }
+
+        /// <summary>
+        /// Upper bound of data rows in [begin, end): the number of line breaks plus a possibly unterminated last line.
+        /// memchr is vectorized in every libc that matters, so this runs at memory bandwidth.
+        /// </summary>
+        inline size_t count_lines(const char* begin, const char* end) {
+            size_t lines = 0;
+            const char* p = begin;
+
+            while (p < end) {
+                const void* nl = std::memchr(p, '\n', end - p);
+                if (nl == nullptr) {
+                    lines++;
+                    break;
+                }
+                lines++;
+                p = static_cast<const char*>(nl) + 1;
+            }
+
+            return lines;
+        }
+
+        /// <summary>
+        /// Exact number of data rows in [begin, end), i.e. the number of digis parse_rows produces with repeat = 1.
+        /// Lines that consist of nothing but '\r' are blank and skipped, as in parse_row.
+        /// </summary>
+        inline size_t count_rows(const char* begin, const char* end) {
+            size_t rows = 0;
+            const char* p = begin;
+
+            while (p < end) {
+                const char* next = next_line(p, end);
+
+                for (const char* c = p; c < next && *c != '\n'; c++) {
+                    if (*c != '\r') {
+                        rows++;
+                        break;
+                    }
+                }
+                p = next;
+            }
+
+            return rows;
+        }
+
+        /// <summary>
+        /// Splits [begin, end) into at most `parts` ranges of roughly equal size that start and end on line boundaries.
+        /// Only depends on the data, so the split (and everything parsed from it) is reproducible.
+        /// </summary>
+        inline std::vector<std::pair<const char*, const char*>> split_lines(const char* begin, const char* end, const size_t parts) {
+            std::vector<std::pair<const char*, const char*>> ranges;
+            const size_t step = (end - begin) / std::max<size_t>(parts, 1) + 1;
+
+            const char* p = begin;
+            while (p < end) {
+                const char* cut = (size_t(end - p) > step) ? next_line(p + step, end) : end;
+                ranges.emplace_back(p, cut);
+                p = cut;
+            }
+
+            return ranges;
+        }
+
+        /// <summary>
+        /// Parses one CSV line into cols. Missing trailing columns (older dumps have no charge) are zero.
+        /// Returns the start of the next line, blank lines yield ncols == 0.
+        /// </summary>
+        inline const char* parse_row(const char* p, const char* end, int (&cols)[csvColumnCount], unsigned int& ncols) {
+            ncols = 0;
+
+            while (p < end && *p != '\n') {
+                if (*p == '\r') {
+                    p++;
+                    continue;
+                }
+
+                int value;
+                p = parse_int(p, end, value);
+                if (ncols < csvColumnCount) {
+                    cols[ncols++] = value;
+                }
+
+                // Skip the separator or anything that is not part of a number.
+                while (p < end && *p != ',' && *p != '\n') { p++; }
+                if (p < end && *p == ',') { p++; }
+            }
+
+            for (unsigned int i = ncols; i < csvColumnCount; i++) {
+                cols[i] = 0;
+            }
+
+            return p < end ? p + 1 : end;
+        }
+
+        /// <summary>
+        /// Parses the data rows in [begin, end) directly into the columns of out, starting at offset, each row repeated
+        /// `repeat` times. Only address, channel, time and charge are kept, the hierarchy columns follow from the address.
+        /// Stops once `capacity` digis are written. Returns the number of digis written and sets `next` to
+        /// the first unconsumed line, so callers can resume (chunked reading) or split files into ranges.
+        /// Calls writing disjoint ranges of out may run concurrently.
+        /// </summary>
+        inline size_t parse_rows(const char* begin, const char* end, CbmStsDigiColumnStore& out, const size_t offset, const size_t capacity, const unsigned int repeat, const char** next = nullptr) {
+            int cols[csvColumnCount];
+            unsigned int ncols;
+            size_t cnt = 0;
+
+            const char* p = begin;
+            while (p < end && cnt < capacity) {
+                p = parse_row(p, end, cols, ncols);
+                if (ncols == 0) { continue; }
+
+                // Artificial duplication of data for testing purposes.
+                for (unsigned int i = 0; i < repeat && cnt < capacity; i++) {
+                    out.set(offset + cnt++, cols[0], cols[8], cols[9], cols[10]);
+                }
+            }
+
+            if (next != nullptr) { *next = p; }
+
+            return cnt;
+        }
+
+    } // namespace csv
+
+    /// <summary>
+    /// Memory maps the CSV file and parses it in place into column storage, without any per line allocation.
+    /// `repeat` duplicates each line, `max_n` caps the number of digis (0 = no cap).
+    /// </summary>
+    CbmStsDigiColumnStore readCsv(const std::string filename, const unsigned int repeat = 1, const unsigned int max_n = 0) {
+        mapped_file file(filename);
+
+        // Skip header
+        const char* data = csv::next_line(file.begin(), file.end());
+
+        size_t capacity = csv::count_lines(data, file.end()) * repeat;
+        if (max_n != 0 && max_n < capacity) {
+            capacity = max_n;
+        }
+
+        CbmStsDigiColumnStore digis;
+        digis.resize(capacity);
+        digis.resize(csv::parse_rows(data, file.end(), digis, 0, capacity, repeat));
+
+        return digis;
+    }
+
+    /// <summary>
+    /// Reads masked channels (hot or dead) into the filter. One "address,channel" pair per line, a header line
+    /// and anything after the second column are ignored.
+    /// </summary>
+    void readChannelMask(const std::string filename, CbmStsDigiFilter& filter) {
+        mapped_file file(filename);
+
+        int cols[csvColumnCount];
+        unsigned int ncols;
+
+        const char* p = file.begin();
+        size_t line = 0;
+        while (p < file.end()) {
+            const char* row = p;
+            p = csv::parse_row(p, file.end(), cols, ncols);
+            line++;
+
+            if (ncols == 0) { continue; }
+            const bool numeric = (*row >= '0' && *row <= '9') || *row == '-';
+            if (!numeric && line == 1) { continue; }
+            if (!numeric || ncols < 2 || cols[1] < 0) {
+                throw std::invalid_argument(filename + ":" + std::to_string(line) + ": expected address,channel");
+            }
+
+            filter.mask(cols[0], static_cast<unsigned short>(std::min(cols[1], 0xFFFF)));
+        }
+    }
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include "mapped_file.h"
+#include "csv.h"
+#include "binary.h"
+#include "../parallel.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    /// <summary>
+    /// Replaces directories by the .csv/.bin files they contain, sorted by name.
+    /// Files keep the order in which they were given, which is the order they are concatenated in.
+    /// </summary>
+    std::vector<std::string> expand_inputs(const std::vector<std::string>& paths) {
+        std::vector<std::string> files;
+
+        for (const auto& path : paths) {
+            if (!std::filesystem::is_directory(path)) {
+                files.push_back(path);
+                continue;
+            }
+
+            std::vector<std::string> entries;
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                const auto ext = entry.path().extension();
+                if (entry.is_regular_file() && (ext == ".csv" || ext == ".bin")) {
+                    entries.push_back(entry.path().string());
+                }
+            }
+            std::sort(entries.begin(), entries.end());
+
+            if (entries.empty()) {
+                throw std::runtime_error("Directory: " + path + " contains no digi files");
+            }
+            files.insert(files.end(), entries.begin(), entries.end());
+        }
+
+        return files;
+    }
+
+    /// <summary>
+    /// Loads one or more digi files (CSV or binary) into one timeslice, using `threads` threads.
+    ///
+    /// Every file is cut into line-aligned byte ranges. The rows of each range are counted in parallel,
+    /// an exclusive sum over the counts (in file and range order) gives each range its output offset,
+    /// and the ranges are then parsed in parallel straight to that offset. The result is therefore identical
+    /// to loading the files one after another with readCsv, independent of the thread count.
+    /// -r repeat and the -n cap (max_n, 0 = no cap) apply to the concatenated input.
+    /// </summary>
+    CbmStsDigiColumnStore readDigis(const std::vector<std::string>& filenames, const unsigned int repeat = 1, const size_t max_n = 0, const unsigned int threads = default_thread_count()) {
+        // Ranges per thread, more than one so that slow ranges are balanced by the dynamic scheduling.
+        constexpr size_t rangesPerThread = 4;
+
+        struct range_t {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+            CbmStsDigiColumns binary;   // For binary files: the rows of this range.
+            size_t rows = 0;
+            size_t offset = 0;
+            size_t capacity = 0;
+        };
+
+        std::vector<std::unique_ptr<mapped_file>> csvFiles;
+        std::vector<std::unique_ptr<CbmStsDigiBinaryFile>> binaryFiles;
+        std::vector<range_t> ranges;
+
+        const size_t parts = std::max(threads, 1u) * rangesPerThread;
+
+        for (const auto& filename : filenames) {
+            if (is_binary_input(filename)) {
+                binaryFiles.emplace_back(new CbmStsDigiBinaryFile(filename));
+                const CbmStsDigiColumns all = binaryFiles.back()->columns();
+                const size_t step = all.n / parts + 1;
+
+                for (size_t i = 0; i < all.n; i += step) {
+                    range_t r;
+                    r.binary = CbmStsDigiColumns{all.address + i, all.channel + i, all.time + i, all.charge + i, std::min(step, all.n - i)};
+                    r.rows = r.binary.n;
+                    ranges.push_back(r);
+                }
+            } else {
+                csvFiles.emplace_back(new mapped_file(filename));
+                const mapped_file& file = *csvFiles.back();
+
+                // Skip header
+                const char* data = csv::next_line(file.begin(), file.end());
+                for (const auto& lines : csv::split_lines(data, file.end(), parts)) {
+                    range_t r;
+                    r.begin = lines.first;
+                    r.end = lines.second;
+                    ranges.push_back(r);
+                }
+            }
+        }
+
+        // -----------------------------------------------------------------------------------
+        // 1. Count rows of each CSV range in parallel.
+        // -----------------------------------------------------------------------------------
+        parallel_for(ranges.size(), threads, [&](const size_t i) {
+            if (ranges[i].begin != nullptr) {
+                ranges[i].rows = csv::count_rows(ranges[i].begin, ranges[i].end);
+            }
+        });
+
+        // -----------------------------------------------------------------------------------
+        // 2. Exclusive sum of the output sizes in input order, applying the cap.
+        // -----------------------------------------------------------------------------------
+        const size_t cap = max_n != 0 ? max_n : SIZE_MAX;
+        size_t n = 0;
+        for (auto& r : ranges) {
+            r.offset = n;
+            r.capacity = std::min(r.rows * repeat, cap - n);
+            n += r.capacity;
+        }
+
+        CbmStsDigiColumnStore store;
+        store.resize(n);
+
+        // -----------------------------------------------------------------------------------
+        // 3. Parse/copy each range to its offset in parallel.
+        // -----------------------------------------------------------------------------------
+        parallel_for(ranges.size(), threads, [&](const size_t i) {
+            const range_t& r = ranges[i];
+            if (r.capacity == 0) { return; }
+
+            if (r.begin == nullptr) {
+                store.assign(r.offset, r.binary, repeat, r.capacity);
+            } else {
+                csv::parse_rows(r.begin, r.end, store, r.offset, r.capacity, repeat);
+            }
+        });
+
+        return store;
+    }
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace experimental {
+
+    /// <summary>
+    /// Read-only memory mapping of a whole file. The mapping lives as long as the object,
+    /// so pointers into data() must not outlive it.
+    /// </summary>
+    class mapped_file {
+        int fd_ = -1;
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+
+    public:
+        explicit mapped_file(const std::string& filename) {
+            fd_ = ::open(filename.c_str(), O_RDONLY);
+            if (fd_ == -1) {
+                throw std::runtime_error("File: " + filename + " not found");
+            }
+
+            struct stat st;
+            if (::fstat(fd_, &st) == -1) {
+                ::close(fd_);
+                throw std::runtime_error("File: " + filename + " cannot be stat'ed");
+            }
+            size_ = st.st_size;
+
+            // mmap of length 0 is an error, an empty file is just an empty range.
+            if (size_ > 0) {
+                void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+                if (p == MAP_FAILED) {
+                    ::close(fd_);
+                    throw std::runtime_error("File: " + filename + " cannot be mapped");
+                }
+                // The loaders stream the file front to back: ask for aggressive read-ahead.
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(p);
+            }
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file() {
+            if (data_ != nullptr) { ::munmap(const_cast<char*>(data_), size_); }
+            if (fd_ != -1) { ::close(fd_); }
+        }
+
+        /// <summary>
+        /// Drops the resident pages of an already consumed range, so streaming over a large file
+        /// does not grow the resident set. The range is shrunk to whole pages; reading it again faults the pages back in.
+        /// </summary>
+        void release(const char* from, const char* to) const {
+            const size_t page = ::sysconf(_SC_PAGESIZE);
+            const size_t first = ((from - data_) + page - 1) / page * page;
+            const size_t last = (to - data_) / page * page;
+
+            if (data_ != nullptr && last > first) {
+                ::madvise(const_cast<char*>(data_) + first, last - first, MADV_DONTNEED);
+            }
+        }
+
+        const char* data() const { return data_; }
+
+        const char* begin() const { return data_; }
+
+        const char* end() const { return data_ + size_; }
+
+        size_t size() const { return size_; }
+    };
+
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+#include "mapped_file.h"
+#include "binary.h"
+#include "../parallel.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    // +--------+------------------+--------------------------+------------------------+----------------------------+---------------------------------+
+    // | Header | digis (digi_t)[n]| startIndex (index_t)[b]  | endIndex (index_t)[b]  | addresses (address_t)[b]   | channelSplitIndex (index_t)[b]  |
+    // +--------+------------------+--------------------------+------------------------+----------------------------+---------------------------------+
+    // Followed by the window per bucket (uint32_t)[b] if the buckets were split into time windows (timeWindow > 0).
+    // The bucketed layout of one input exactly as CbmStsDigiBucket holds it in memory. Sections are aligned
+    // like the binary digi files, so a mapped snapshot is used as bucket in place.
+    constexpr char snapshotMagic[8] = {'S', 'T', 'S', 'S', 'N', 'A', 'P', '\0'};
+    constexpr uint32_t snapshotVersion = 3;
+
+    struct CbmStsDigiSnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        // sizeof(digi_t): DEBUG_SORT builds carry the address in every digi.
+        uint32_t digiSize;
+        // Hash of the input content, -r, -n, -t and the filter (see snapshot_key).
+        uint64_t key;
+        uint64_t n;
+        uint64_t bucketCount;
+        uint64_t timeWindow;
+
+        // Byte offsets from the beginning of the file.
+        uint64_t digiOffset;
+        uint64_t startIndexOffset;
+        uint64_t endIndexOffset;
+        uint64_t addressOffset;
+        uint64_t channelSplitIndexOffset;
+        uint64_t windowOffset;
+    };
+
+    namespace snapshot {
+
+        inline uint64_t mix(uint64_t h, const uint64_t value) {
+            h ^= value * 0x9E3779B97F4A7C15ULL;
+            h = (h << 27) | (h >> 37);
+            return h * 0xBF58476D1CE4E5B9ULL + 0x94D049BB133111EBULL;
+        }
+
+        /// <summary>
+        /// 64 bit hash of a byte range, word by word. Not cryptographic, only has to tell inputs apart.
+        /// </summary>
+        inline uint64_t hash_range(const char* p, const size_t bytes) {
+            uint64_t h = bytes;
+            size_t i = 0;
+
+            for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+                uint64_t word;
+                std::memcpy(&word, p + i, sizeof(word));
+                h = mix(h, word);
+            }
+
+            uint64_t tail = 0;
+            std::memcpy(&tail, p + i, bytes - i);
+            return mix(h, tail);
+        }
+
+        inline CbmStsDigiSnapshotHeader make_header(const uint64_t key, const uint64_t n, const uint64_t bucketCount, const uint32_t timeWindow) {
+            CbmStsDigiSnapshotHeader header{};
+            std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+            header.version = snapshotVersion;
+            header.digiSize = sizeof(digi_t);
+            header.key = key;
+            header.n = n;
+            header.bucketCount = bucketCount;
+            header.timeWindow = timeWindow;
+
+            header.digiOffset = binary::align(sizeof(CbmStsDigiSnapshotHeader));
+            header.startIndexOffset = binary::align(header.digiOffset + n * sizeof(digi_t));
+            header.endIndexOffset = binary::align(header.startIndexOffset + bucketCount * sizeof(index_t));
+            header.addressOffset = binary::align(header.endIndexOffset + bucketCount * sizeof(index_t));
+            header.channelSplitIndexOffset = binary::align(header.addressOffset + bucketCount * sizeof(address_t));
+            header.windowOffset = binary::align(header.channelSplitIndexOffset + bucketCount * sizeof(index_t));
+
+            return header;
+        }
+
+        /// <summary>
+        /// Charge threshold and channel masks, the masks in ascending address order (the map is unordered).
+        /// </summary>
+        inline uint64_t filter_hash(uint64_t h, const CbmStsDigiFilter& filter) {
+            std::vector<address_t> addresses;
+            addresses.reserve(filter.masks().size());
+            for (const auto& m : filter.masks()) { addresses.push_back(m.first); }
+            std::sort(addresses.begin(), addresses.end());
+
+            h = mix(h, filter.minCharge());
+            for (const address_t address : addresses) {
+                h = mix(h, static_cast<uint32_t>(address));
+                const uint64_t* mask = filter.channelMask(address);
+                for (size_t w = 0; w < CbmStsDigiFilter::maskWords; w++) { h = mix(h, mask[w]); }
+            }
+            return h;
+        }
+
+    } // namespace snapshot
+
+    /// <summary>
+    /// Cache key of an input: hash over the content of all files (in order), -r, -n, the time window length
+    /// and the filter (if any). Files are hashed in blocks in parallel, the block hashes are combined in order.
+    /// </summary>
+    uint64_t snapshot_key(const std::vector<std::string>& filenames, const unsigned int repeat, const size_t max_n, const uint32_t timeWindow = 0, const CbmStsDigiFilter* filter = nullptr, const unsigned int threads = default_thread_count()) {
+        constexpr size_t blockBytes = 16 << 20;
+
+        uint64_t key = snapshot::mix(snapshot::mix(snapshot::mix(snapshotVersion, repeat), max_n), timeWindow);
+        if (filter != nullptr && filter->active()) {
+            key = snapshot::filter_hash(key, *filter);
+        }
+
+        for (const auto& filename : filenames) {
+            const mapped_file file(filename);
+            const size_t blocks = (file.size() + blockBytes - 1) / blockBytes;
+            std::vector<uint64_t> hashes(blocks);
+
+            parallel_for(blocks, threads, [&](const size_t b) {
+                const size_t begin = b * blockBytes;
+                hashes[b] = snapshot::hash_range(file.data() + begin, std::min(blockBytes, file.size() - begin));
+            });
+
+            key = snapshot::mix(key, file.size());
+            for (const uint64_t h : hashes) {
+                key = snapshot::mix(key, h);
+            }
+        }
+
+        return key;
+    }
+
+    inline std::string snapshot_path(const std::string& dir, const uint64_t key) {
+        std::stringstream ss;
+        ss << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".snap";
+        return ss.str();
+    }
+
+    /// <summary>
+    /// Persists the bucketed layout. Written to a temporary file and renamed, so concurrent runs
+    /// never map a partially written snapshot.
+    /// </summary>
+    void writeSnapshot(const std::string& filename, const CbmStsDigiBucket& bucket, const uint64_t key) {
+        const std::string tmp = filename + ".tmp";
+
+        {
+            std::ofstream file(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                throw std::runtime_error("File: " + tmp + " cannot be written");
+            }
+
+            const CbmStsDigiSnapshotHeader header = snapshot::make_header(key, bucket.n(), bucket.size(), bucket.timeWindow());
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            binary::write_column(file, header.digiOffset, bucket.digis, bucket.n() * sizeof(digi_t));
+            binary::write_column(file, header.startIndexOffset, bucket.startIndex, bucket.size() * sizeof(index_t));
+            binary::write_column(file, header.endIndexOffset, bucket.endIndex, bucket.size() * sizeof(index_t));
+            binary::write_column(file, header.addressOffset, bucket.address(), bucket.size() * sizeof(address_t));
+            binary::write_column(file, header.channelSplitIndexOffset, bucket.channelSplitIndex, bucket.size() * sizeof(index_t));
+            if (header.timeWindow > 0) {
+                binary::write_column(file, header.windowOffset, bucket.windows(), bucket.size() * sizeof(uint32_t));
+            }
+
+            if (!file.good()) {
+                throw std::runtime_error("File: " + tmp + " write failed");
+            }
+        }
+
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("File: " + filename + " cannot be written");
+        }
+    }
+
+    /// <summary>
+    /// Memory mapped snapshot. bucket() is a view of the mapped sections: nothing is copied or
+    /// bucketed, pages are read when a benchmark copies the digis. The mapping is read-only.
+    /// </summary>
+    class CbmStsDigiSnapshot {
+        mapped_file file;
+        std::unique_ptr<CbmStsDigiBucket> bucket_;
+
+        template<typename T>
+        T* section(const uint64_t offset) const {
+            return reinterpret_cast<T*>(const_cast<char*>(file.data() + offset));
+        }
+
+    public:
+        /// <summary>
+        /// Throws if the file is no snapshot, was written by a build with another digi layout or for another key.
+        /// </summary>
+        CbmStsDigiSnapshot(const std::string& filename, const uint64_t key) : file(filename) {
+            const auto* header = reinterpret_cast<const CbmStsDigiSnapshotHeader*>(file.data());
+
+            if (file.size() < sizeof(CbmStsDigiSnapshotHeader) || std::memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+                throw std::runtime_error("File: " + filename + " is not a snapshot");
+            }
+            if (header->version != snapshotVersion || header->digiSize != sizeof(digi_t)) {
+                throw std::runtime_error("File: " + filename + " was written by an incompatible build");
+            }
+            if (header->key != key) {
+                throw std::runtime_error("File: " + filename + " belongs to another input");
+            }
+            const uint64_t end = header->timeWindow > 0 ? header->windowOffset + header->bucketCount * sizeof(uint32_t) : header->channelSplitIndexOffset + header->bucketCount * sizeof(index_t);
+            if (end > file.size()) {
+                throw std::runtime_error("File: " + filename + " is truncated");
+            }
+
+            bucket_.reset(new CbmStsDigiBucket(header->n, header->bucketCount,
+                section<CbmStsDigi>(header->digiOffset),
+                section<index_t>(header->startIndexOffset),
+                section<index_t>(header->endIndexOffset),
+                section<address_t>(header->addressOffset),
+                section<index_t>(header->channelSplitIndexOffset),
+                header->timeWindow > 0 ? section<uint32_t>(header->windowOffset) : nullptr,
+                static_cast<uint32_t>(header->timeWindow)));
+        }
+
+        const CbmStsDigiBucket* bucket() const { return bucket_.get(); }
+    };
+
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../parallel.h"
+#include "../datastructures.h"
+
+namespace experimental {
+
+    enum class OutputFormat { csv, binary };
+
+    // +--------+--------------------+--------------------------------------------------------+
+    // | Header | digis (digi_t)[n]  | bucket index: address, start, end, window [bucketCount] |
+    // +--------+--------------------+--------------------------------------------------------+
+    // The digis are the raw sorted array, exactly as the sorters produce it. If the buckets were split into time
+    // windows, timeWindow is the window length and an address has one entry per window (else both are 0).
+    constexpr char sortedMagic[8] = {'S', 'T', 'S', 'S', 'O', 'R', 'T', '\0'};
+    constexpr uint32_t sortedVersion = 2;
+
+    struct CbmStsSortedFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t digiSize;
+        uint64_t n;
+        uint64_t bucketCount;
+        uint64_t digiOffset;
+        uint64_t indexOffset;
+        uint64_t timeWindow;
+    };
+
+    struct CbmStsSortedFileIndex {
+        int32_t address;
+        uint32_t start;
+        uint32_t end;
+        uint32_t window;
+    };
+
+    namespace writer {
+
+        // Digits are written in pairs from a table, which halves the number of divisions.
+        constexpr char digitPairs[201] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        // Max. bytes of one CSV line: 5 (channel) + 10 (time) + 5 (charge) + 2 separators + newline.
+#ifdef DEBUG_SORT
+        // Plus signed address and separator.
+        constexpr size_t maxCsvLineBytes = 23 + 12;
+#else
+        constexpr size_t maxCsvLineBytes = 23;
+#endif
+
+        // Digis formatted per task.
+        constexpr size_t csvChunkSize = 1 << 16;
+
+        /// <summary>
+        /// Writes the decimal representation of value to out and returns the end. Same output as std::to_string.
+        /// </summary>
+        inline char* format_uint(char* out, uint32_t value) {
+            char buf[10];
+            char* p = buf + sizeof(buf);
+
+            while (value >= 100) {
+                const uint32_t pair = (value % 100) * 2;
+                value /= 100;
+                *--p = digitPairs[pair + 1];
+                *--p = digitPairs[pair];
+            }
+            if (value >= 10) {
+                *--p = digitPairs[value * 2 + 1];
+                *--p = digitPairs[value * 2];
+            } else {
+                *--p = static_cast<char>('0' + value);
+            }
+
+            const size_t len = buf + sizeof(buf) - p;
+            std::memcpy(out, p, len);
+            return out + len;
+        }
+
+        inline char* format_int(char* out, const int value) {
+            if (value < 0) {
+                *out++ = '-';
+                return format_uint(out, 0u - static_cast<uint32_t>(value));
+            }
+            return format_uint(out, static_cast<uint32_t>(value));
+        }
+
+        /// <summary>
+        /// Formats digis like CbmStsDigi::to_csv() followed by a newline. out must hold maxCsvLineBytes per digi.
+        /// Returns the end of the written text.
+        /// </summary>
+        inline char* format_csv(char* out, const digi_t* digis, const size_t n) {
+            for (size_t i = 0; i < n; i++) {
+#ifdef DEBUG_SORT
+                out = format_int(out, digis[i].address);
+                *out++ = ',';
+#endif
+                out = format_uint(out, digis[i].channel);
+                *out++ = ',';
+                out = format_uint(out, digis[i].time);
+                *out++ = ',';
+                out = format_uint(out, digis[i].charge);
+                *out++ = '\n';
+            }
+            return out;
+        }
+
+        inline int open_output(const std::string& filename) {
+            const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1) {
+                throw std::runtime_error("File: " + filename + " cannot be written");
+            }
+            return fd;
+        }
+
+        /// <summary>
+        /// pwrite until everything is written. Positional writes do not share a file offset,
+        /// so different threads can write disjoint ranges of the same file concurrently.
+        /// </summary>
+        inline void pwrite_all(const int fd, const void* data, size_t bytes, off_t offset) {
+            const char* p = static_cast<const char*>(data);
+
+            while (bytes > 0) {
+                const ssize_t written = ::pwrite(fd, p, bytes, offset);
+                if (written <= 0) {
+                    throw std::runtime_error("Write failed: " + std::string(std::strerror(errno)));
+                }
+                p += written;
+                bytes -= written;
+                offset += written;
+            }
+        }
+
+    } // namespace writer
+
+    /// <summary>
+    /// Writes the sorted digis as CSV, byte identical to streaming CbmStsDigi::to_csv() lines through an ofstream.
+    /// Chunks are formatted in parallel into preallocated buffers, an exclusive sum over the chunk lengths
+    /// gives their file offsets and every chunk is written with pwrite.
+    /// </summary>
+    void writeSortedCsv(const std::string& filename, const digi_t* sorted, const size_t n, const unsigned int threads = default_thread_count()) {
+        const std::string header = digi_t::csv_headers() + "\n";
+        const size_t chunks = (n + writer::csvChunkSize - 1) / writer::csvChunkSize;
+
+        std::vector<std::vector<char>> buffers(chunks);
+        std::vector<size_t> lengths(chunks);
+
+        parallel_for(chunks, threads, [&](const size_t c) {
+            const size_t begin = c * writer::csvChunkSize;
+            const size_t count = std::min(writer::csvChunkSize, n - begin);
+
+            buffers[c].resize(count * writer::maxCsvLineBytes);
+            lengths[c] = writer::format_csv(buffers[c].data(), sorted + begin, count) - buffers[c].data();
+        });
+
+        std::vector<size_t> offsets(chunks);
+        size_t offset = header.size();
+        for (size_t c = 0; c < chunks; c++) {
+            offsets[c] = offset;
+            offset += lengths[c];
+        }
+
+        const int fd = writer::open_output(filename);
+        try {
+            writer::pwrite_all(fd, header.data(), header.size(), 0);
+            parallel_for(chunks, threads, [&](const size_t c) {
+                writer::pwrite_all(fd, buffers[c].data(), lengths[c], offsets[c]);
+            });
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+
+    /// <summary>
+    /// Raw binary dump of the sorted digi array plus the bucket index table (if a bucket is given),
+    /// written with pwrite in parallel slices.
+    /// </summary>
+    void writeSortedBinary(const std::string& filename, const digi_t* sorted, const size_t n, const bucket_t* bucket = nullptr, const unsigned int threads = default_thread_count()) {
+        // Bytes per pwrite task.
+        constexpr size_t sliceBytes = 64 << 20;
+
+        const count_t bucketCount = bucket != nullptr ? bucket->size() : 0;
+
+        CbmStsSortedFileHeader header{};
+        std::memcpy(header.magic, sortedMagic, sizeof(sortedMagic));
+        header.version = sortedVersion;
+        header.digiSize = sizeof(digi_t);
+        header.n = n;
+        header.bucketCount = bucketCount;
+        header.digiOffset = sizeof(header);
+        header.indexOffset = header.digiOffset + n * sizeof(digi_t);
+        header.timeWindow = bucket != nullptr ? bucket->timeWindow() : 0;
+
+        std::vector<CbmStsSortedFileIndex> index(bucketCount);
+        for (count_t i = 0; i < bucketCount; i++) {
+            index[i] = CbmStsSortedFileIndex{bucket->getAddress(i), bucket->begin(i), bucket->end(i), bucket->window(i)};
+        }
+
+        const size_t digiBytes = n * sizeof(digi_t);
+        const size_t slices = (digiBytes + sliceBytes - 1) / sliceBytes;
+
+        const int fd = writer::open_output(filename);
+        try {
+            writer::pwrite_all(fd, &header, sizeof(header), 0);
+            parallel_for(slices, threads, [&](const size_t s) {
+                const size_t begin = s * sliceBytes;
+                writer::pwrite_all(fd, reinterpret_cast<const char*>(sorted) + begin, std::min(sliceBytes, digiBytes - begin), header.digiOffset + begin);
+            });
+            writer::pwrite_all(fd, index.data(), index.size() * sizeof(CbmStsSortedFileIndex), header.indexOffset);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <xpu/device.h>
+#include "datastructures.h"
+#include "types.h"
+
+namespace experimental {
+
+    /// <summary>
+    /// Read policies of the sort kernels for the two bucket layouts (CbmStsDigiAoS, CbmStsDigiSoA on the host).
+    /// The kernel bodies are templates over these: channel(i) is all the histogram phase reads, digi(i) assembles the
+    /// whole digi for the placement. With SoA the histogram reads 2 instead of 8 bytes per digi.
+    /// Passed to the kernels by value.
+    /// </summary>
+    struct AoSDigis {
+        const digi_t* digis;
+
+        XPU_D unsigned short channel(const index_t i) const { return digis[i].channel; }
+        XPU_D digi_t digi(const index_t i) const { return digis[i]; }
+    };
+
+    struct SoADigis {
+        const unsigned short* channels;
+        const unsigned int* times;
+        const unsigned short* charges;
+
+        XPU_D unsigned short channel(const index_t i) const { return channels[i]; }
+        XPU_D digi_t digi(const index_t i) const { return digi_t(channels[i], times[i], charges[i]); }
+    };
+
+}
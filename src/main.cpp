@@ -1,11 +1,25 @@
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include "common.h"
+#include "io/binary.h"
+#include "io/ingest.h"
+#include "io/archive.h"
+#include "io/snapshot.h"
+#include "streaming.h"
 
 #include "../benchmarks/blocksort.h"
 #include "../benchmarks/stdsort.h"
 #include "../benchmarks/jansergeysort.h"
+#include "../benchmarks/devicebucketing.h"
+#include "../benchmarks/channelstats.h"
+#include "../benchmarks/countingsort.h"
+#include "../benchmarks/sizeclass.h"
+#include "../benchmarks/segmentedsort.h"
 //#include "../benchmarks/partition.h"
 
 #include "sorting/BlockSort.h"
@@ -13,6 +27,11 @@
 #include "sorting/JanSergeySortSingleBlock.h"
 #include "sorting/JanSergeySortSimple.h"
 #include "sorting/JanSergeySortParInsert.h"
+#include "sorting/JanSergeySortParScatter.h"
+#include "sorting/JanSergeySortSmall.h"
+#include "sorting/JanSergeySortNarrow.h"
+#include "sorting/SegmentedSort.h"
+#include "algo/Bucketing.h"
 //#include "algo/Partition.h"
 
 int main(int argc, char** argv) {
@@ -20,17 +39,28 @@ int main(int argc, char** argv) {
         // Command line params.
         std::string input
         ;
+        std::vector<std::string> inputs;
         std::string output;
         unsigned int repeat = 1;
         unsigned int max_n = 0;
         bool writeOutput = false;
+        experimental::OutputFormat outputFormat = experimental::OutputFormat::csv;
         bool checkResult = false;
         std::string benchmark_subfolder = "";
+        bool streaming = false;
+        size_t memory_budget_mb = 512;
+        unsigned int threads = experimental::default_thread_count();
+        std::string snapshot_dir = "";
+        uint32_t time_window = 0;
+        experimental::CbmStsDigiFilter filter;
+        std::string channel_stats = "";
 
         for (int i = 1; i < argc; i++) {
             if (strcmp(argv[i], "-i") == 0) {
-                input = argv[i + 1];
-                std::cout << "Input: " << input << "\n";
+                // May be given several times (or be a directory), the files are concatenated in order.
+                if (input == "") input = argv[i + 1];
+                inputs.push_back(argv[i + 1]);
+                std::cout << "Input: " << argv[i + 1] << "\n";
             } else if (strcmp(argv[i], "-o") == 0) {
                 output = argv[i + 1];
                 std::cout << "Output: " << output << "\n";
@@ -40,6 +70,11 @@ int main(int argc, char** argv) {
             } else if (strcmp(argv[i], "-w") == 0) {
                 writeOutput = true;
                 std::cout << "Writing sorted output to CSV file.\n";
+            } else if (strcmp(argv[i], "-W") == 0) {
+                // Raw sorted digis plus bucket index table, for large n where CSV formatting dominates.
+                writeOutput = true;
+                outputFormat = experimental::OutputFormat::binary;
+                std::cout << "Writing sorted output to binary file.\n";
             } else if (strcmp(argv[i], "-r") == 0) {
                 repeat = std::stoi(argv[i + 1]);
                 std::cout << "Repeat: " << repeat << "\n";
@@ -50,20 +85,155 @@ int main(int argc, char** argv) {
             } else if (strcmp(argv[i], "-b") == 0) {
                 benchmark_subfolder = argv[i + 1];
                 std::cout << "Writing benchmarks to file: " << benchmark_subfolder << "\n";
+            } else if (strcmp(argv[i], "-s") == 0) {
+                streaming = true;
+                std::cout << "Streaming mode.\n";
+            } else if (strcmp(argv[i], "-m") == 0) {
+                // Memory budget of the streaming mode in MiB.
+                memory_budget_mb = std::stoul(argv[i + 1]);
+                std::cout << "Memory budget: " << memory_budget_mb << " MiB\n";
+            } else if (strcmp(argv[i], "-j") == 0) {
+                // Threads used for loading the input.
+                threads = std::stoul(argv[i + 1]);
+                std::cout << "Threads: " << threads << "\n";
+            } else if (strcmp(argv[i], "-k") == 0) {
+                // Cache directory for bucketed snapshots of the input.
+                snapshot_dir = argv[i + 1];
+                std::cout << "Snapshot cache: " << snapshot_dir << "\n";
+            } else if (strcmp(argv[i], "-t") == 0) {
+                // Buckets keyed by (address, time / length) instead of address.
+                time_window = std::stoul(argv[i + 1]);
+                std::cout << "Time window: " << time_window << "\n";
+            } else if (strcmp(argv[i], "-q") == 0) {
+                // Digis below this charge are dropped during bucketing.
+                filter.setMinCharge(static_cast<unsigned short>(std::stoul(argv[i + 1])));
+                std::cout << "Charge threshold: " << filter.minCharge() << "\n";
+            } else if (strcmp(argv[i], "-x") == 0) {
+                // Masked channels (address,channel per line), dropped during bucketing.
+                experimental::readChannelMask(argv[i + 1], filter);
+                std::cout << "Channel mask: " << argv[i + 1] << "\n";
+            } else if (strcmp(argv[i], "-S") == 0) {
+                // Per (bucket, channel) statistics exported by the sort: "counts", or counts plus "charge" and/or "time".
+                channel_stats = argv[i + 1];
+                std::cout << "Channel statistics: " << channel_stats << "\n";
             }
         }
 
         if (input == "") throw std::invalid_argument("Input digis input file missing");
+        inputs = experimental::expand_inputs(inputs);
+
+        if (streaming) {
+            if (inputs.size() > 1) throw std::invalid_argument("Streaming mode supports a single input file");
+            if (experimental::is_archive_input(inputs.front())) throw std::invalid_argument("Streaming mode does not support archive inputs");
+            if (time_window > 0) throw std::invalid_argument("Streaming mode does not support time windows");
+            if (filter.active()) throw std::invalid_argument("Streaming mode does not support filtering");
+
+            // Bounded memory: the input is never fully loaded, sorted runs go to -o (if given).
+            xpu::initialize();
+
+            experimental::stream_sorter<experimental::JanSergeySortSingleBlock> sorter(memory_budget_mb * 1024 * 1024);
+            const auto result = sorter.run(inputs.front(), repeat, max_n, output);
+
+            std::cout << "Streamed " << result.digis << " digis in " << result.chunks << " chunks (" << result.runs << " sorted runs)\n";
+            std::cout << "Total: " << result.seconds * 1000 << "ms, sort kernels: " << result.sortMs << "ms\n";
+            std::cout << "Sustained: " << result.digis_per_second() << " digis/s\n";
+            std::cout << "Bucketing allocations: " << result.firstChunk.allocations << " in the first chunk, " << result.laterChunks.allocations << " in later chunks (" << result.laterChunks.minorFaults << " page faults)\n";
+            return 0;
+        }
+
+        // A single binary input is mapped and used in place, an archive is decoded straight into buckets,
+        // everything else is loaded in parallel into column storage.
+        // With -k the bucketed layout is cached: a snapshot of the same input (content, -r, -n, -t, -q, -x) is mapped instead.
+        std::unique_ptr<experimental::CbmStsDigiBinaryFile> binaryFile;
+        std::unique_ptr<bucket_t> inputBucket;
+        std::unique_ptr<experimental::CbmStsDigiSnapshot> snapshot;
+        experimental::CbmStsDigiColumnStore store;
+        experimental::CbmStsDigiColumns digis;
+
+        const auto loadStarted = std::chrono::high_resolution_clock::now();
+        for (const auto& file : inputs) {
+            if (experimental::is_archive_input(file) && inputs.size() > 1) throw std::invalid_argument("Archive inputs cannot be combined with other inputs");
+        }
 
-        // Read CSV and load into raw array.
-        auto vDigis = experimental::readCsv(input, repeat, max_n);
-        std::cout << "CSV loaded." << "\n\n";
+        // Archives are stored bucketed already.
+        const bool useSnapshot = snapshot_dir != "" && !experimental::is_archive_input(inputs.front());
+        uint64_t snapshotKey = 0;
+        std::string snapshotFile;
 
-        // Copy digis to raw array.
-        experimental::CbmStsDigiInput* aDigis = new experimental::CbmStsDigiInput[vDigis.size()];
-        const size_t n = vDigis.size();
-        std::copy(vDigis.begin(), vDigis.end(), aDigis);
-        std::cout << "Copied array of size: " << n << "\n\n";
+        if (useSnapshot) {
+            snapshotKey = experimental::snapshot_key(inputs, repeat, max_n, time_window, &filter, threads);
+            snapshotFile = experimental::snapshot_path(snapshot_dir, snapshotKey);
+
+            if (experimental::file_exists(snapshotFile)) {
+                try {
+                    snapshot.reset(new experimental::CbmStsDigiSnapshot(snapshotFile, snapshotKey));
+                    std::cout << "Snapshot: " << snapshotFile << "\n";
+                } catch (std::exception& e) {
+                    std::cerr << e.what() << ", rebuilding\n";
+                }
+            }
+        }
+
+        if (snapshot) {
+            // Nothing to load.
+        } else if (experimental::is_archive_input(inputs.front())) {
+            if (repeat > 1 || max_n != 0) throw std::invalid_argument("-r and -n are not supported for archive inputs");
+            if (filter.active()) throw std::invalid_argument("-q and -x are not supported for archive inputs");
+
+            inputBucket.reset(experimental::readArchive(inputs.front(), threads));
+        } else if (inputs.size() == 1 && experimental::is_binary_input(inputs.front())) {
+            binaryFile.reset(new experimental::CbmStsDigiBinaryFile(inputs.front()));
+            digis = binaryFile->columns();
+
+            if (repeat > 1) {
+                // Repeating cannot be done in place.
+                store = experimental::CbmStsDigiColumnStore(digis.first(max_n != 0 ? (max_n + repeat - 1) / repeat : digis.n), repeat);
+                digis = store.view();
+            }
+            if (max_n != 0) {
+                digis = digis.first(max_n);
+            }
+        } else {
+            store = experimental::readDigis(inputs, repeat, max_n, threads);
+            digis = store.view();
+        }
+
+        if (!snapshot && !inputBucket && (useSnapshot || time_window > 0 || filter.active())) {
+            // Bucket once and let all benchmarks share the bucket: to persist it, to split it into time windows
+            // or to drop the filtered digis before anything is uploaded.
+            inputBucket.reset(new bucket_t());
+            inputBucket->setFilter(&filter);
+            inputBucket->reset(digis, threads);
+        }
+        if (!snapshot && filter.active()) {
+            const size_t rejected = inputBucket->rejectedCount();
+            std::cout << "Filtered: " << rejected << " of " << digis.n << " digis rejected (" << (digis.n > 0 ? 100.0 * rejected / digis.n : 0.0) << "%)\n";
+
+            // Modules with the most rejections.
+            auto modules = inputBucket->rejections();
+            std::stable_sort(modules.begin(), modules.end(), [](const experimental::CbmStsModuleRejections& a, const experimental::CbmStsModuleRejections& b) { return a.rejected > b.rejected; });
+            for (size_t m = 0; m < modules.size() && m < 10 && modules[m].rejected > 0; m++) {
+                std::cout << "  address " << modules[m].address << ": " << modules[m].rejected << " rejected, " << modules[m].accepted << " accepted\n";
+            }
+        }
+        if (!snapshot && time_window > 0) {
+            inputBucket->splitTimeWindows(time_window, threads);
+            std::cout << "Time windows: " << inputBucket->size() << " buckets\n";
+        }
+
+        if (useSnapshot && !snapshot) {
+            // First run on this input: persist the bucket.
+            experimental::create_dir(snapshot_dir);
+            experimental::writeSnapshot(snapshotFile, *inputBucket, snapshotKey);
+            std::cout << "Snapshot written: " << snapshotFile << "\n";
+        }
+        const auto loadDone = std::chrono::high_resolution_clock::now();
+
+        const bucket_t* bucket = snapshot ? snapshot->bucket() : inputBucket.get();
+        const experimental::CbmStsDigiSource source = bucket != nullptr ? experimental::CbmStsDigiSource(bucket) : experimental::CbmStsDigiSource(digis);
+        const size_t n = source.size();
+        const float loadMs = std::chrono::duration<float, std::milli>(loadDone - loadStarted).count();
+        std::cout << "Input loaded: " << n << " digis in " << loadMs << "ms" << "\n\n";
 
         // Benchmark.
         setenv("XPU_PROFILE", "1", 1); // always enable profiling in benchmark
@@ -71,27 +241,68 @@ int main(int argc, char** argv) {
         xpu::initialize();
 
         experimental::benchmark_runner runner(benchmark_subfolder, input);
+        runner.set_load_time(loadMs);
+        runner.set_output_format(outputFormat, threads);
 
         // Run block sort on all devices.
-        runner.add(new experimental::blocksort_bench<experimental::BlockSort>(aDigis, n, writeOutput, checkResult));
-        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSingleBlock>("ConcatSort (single block)", aDigis, n, writeOutput, checkResult, 1));
+        runner.add(new experimental::blocksort_bench<experimental::BlockSort>(source, writeOutput, checkResult));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSingleBlock>("ConcatSort (single block)", source, writeOutput, checkResult, 1));
+        // Same as single block, with a parallel exclusive sum and a parallel stable placement.
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortParScatter>("ConcatSort (single block, par scatter)", source, writeOutput, checkResult, 1));
+        // Same with one sub-histogram per warp, against hot channels (e.g. digigen -p one-channel).
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortWarpHistogram>("ConcatSort (single block, warp histograms)", source, writeOutput, checkResult, 1));
+        // Buckets are laid out front side first: one block sorts the front side, one the back side of a bucket.
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySort, true>("ConcatSort (two blocks)", source, writeOutput, checkResult, 2));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortParInsert, true>("ConcatSort (two blocks, par insert)", source, writeOutput, checkResult, 2));
+        // One block per bucket with a single-threaded exclusive sum and placement, as a baseline for the others.
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSimple>("ConcatSort (simple)", source, writeOutput, checkResult, 1));
+        // Same kernels on the SoA layout: the histogram phase reads only the channel column.
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSingleBlockSoA, false, experimental::CbmStsDigiSoA>("ConcatSort (single block, SoA)", source, writeOutput, checkResult, 1));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSoA, true, experimental::CbmStsDigiSoA>("ConcatSort (two blocks, SoA)", source, writeOutput, checkResult, 2));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortParInsertSoA, true, experimental::CbmStsDigiSoA>("ConcatSort (two blocks, par insert, SoA)", source, writeOutput, checkResult, 2));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSimpleSoA, false, experimental::CbmStsDigiSoA>("ConcatSort (simple, SoA)", source, writeOutput, checkResult, 1));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortParScatterSoA, false, experimental::CbmStsDigiSoA>("ConcatSort (single block, par scatter, SoA)", source, writeOutput, checkResult, 1));
+        runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortWarpHistogramSoA, false, experimental::CbmStsDigiSoA>("ConcatSort (single block, warp histograms, SoA)", source, writeOutput, checkResult, 1));
+        // Kernel per bucket size: no histogram for small buckets, two blocks for large ones. Timed per class as well.
+        runner.add(new experimental::sizeclass_bench<>("ConcatSort (by bucket size)", source, writeOutput, checkResult));
+        // Same with 16 bit counters over the bucket's channel range for the mid-size buckets: half the shared memory per block.
+        runner.add(new experimental::sizeclass_bench<experimental::JanSergeySortNarrow>("ConcatSort (by bucket size, narrow histograms)", source, writeOutput, checkResult));
+        // Work plan: small buckets packed per block, large ones split into chunks of equal size across blocks.
+        runner.add(new experimental::segmentedsort_bench("ConcatSort (load balanced)", source, writeOutput, checkResult));
+
+        // Benches below depend on the input and the options, skipped ones keep their (empty) column in the CSV files.
+        const std::string channelStatsName = "ConcatSort (single block, channel stats)";
+        if (channel_stats != "") {
+            const bool all = channel_stats == "all";
+            runner.add(new experimental::channelstats_bench(channelStatsName, source, all || channel_stats.find("charge") != std::string::npos, all || channel_stats.find("time") != std::string::npos, writeOutput, checkResult));
+        } else {
+            runner.skip(channelStatsName);
+        }
+
+        // Raw columns only: bucketed on the device instead of the host.
+        const std::string deviceBucketingName = "ConcatSort (device bucketing)";
+        if (source.bucket == nullptr) {
+            runner.add(new experimental::devicebucketing_bench<experimental::JanSergeySortSingleBlock>(deviceBucketingName, source.columns, writeOutput, checkResult));
+            // Host only, from the raw columns to the sorted output.
+            runner.add(new experimental::countingsort_bench(source.columns, experimental::HostSortMode::countingSort, threads, writeOutput, checkResult));
+            runner.add(new experimental::countingsort_bench(source.columns, experimental::HostSortMode::bucketThenSort, threads, writeOutput, checkResult));
+        } else {
+            runner.skip(deviceBucketingName);
+            runner.skip(experimental::countingsort_bench::name(experimental::HostSortMode::countingSort));
+            runner.skip(experimental::countingsort_bench::name(experimental::HostSortMode::bucketThenSort));
+        }
     
         if (xpu::active_driver() != xpu::cpu) {
             std::cout << "Using GPU.\n\n";
-            //runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySort>(aDigis, n, writeOutput, checkResult));
-            //runner.add(new experimental::partition_bench<experimental::Partition>("Partition", aDigis, n, writeOutput, checkResult));
-            //runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortSimple>(aDigis, n, writeOutput, checkResult, 1));
-            //runner.add(new experimental::jansergeysort_bench<experimental::JanSergeySortParInsert>(aDigis, n, writeOutput, checkResult));
-            // const CbmStsDigiInput* in_digis, const size_t in_n, const bool in_write = false, const bool in_check = true, unsigned int in_block_per_bucket = 2
+            //runner.add(new experimental::partition_bench<experimental::Partition>("Partition", source, writeOutput, checkResult));
+            // const CbmStsDigiSource& in_digis, const bool in_write = false, const bool in_check = true, unsigned int in_block_per_bucket = 2
         } else {
             std::cout << "No GPU device used.\n\n";
-            runner.add(new experimental::stdsort_bench(aDigis, n, experimental::SortMode::seq, writeOutput, checkResult));
-            //runner.add(new experimental::stdsort_bench(aDigis, n, experimental::SortMode::par, writeOutput, checkResult));
+            runner.add(new experimental::stdsort_bench(source, experimental::SortMode::seq, writeOutput, checkResult));
+            //runner.add(new experimental::stdsort_bench(source, experimental::SortMode::par, writeOutput, checkResult));
         }
 
         runner.run(10);
-
-        delete[] aDigis;
     }
     catch (std::exception& e) {
         std::cerr << e.what() << "\n";
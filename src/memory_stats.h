@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <sys/resource.h>
+
+namespace experimental {
+
+    /// <summary>
+    /// Allocations and page faults of one piece of work (e.g. bucketing one timeslice).
+    /// Page faults are taken from getrusage and count the whole process, including other threads.
+    /// </summary>
+    struct memory_stats {
+        size_t allocations = 0;
+        size_t allocatedBytes = 0;
+        long minorFaults = 0;
+        long majorFaults = 0;
+
+        memory_stats& operator+=(const memory_stats& other) {
+            allocations += other.allocations;
+            allocatedBytes += other.allocatedBytes;
+            minorFaults += other.minorFaults;
+            majorFaults += other.majorFaults;
+            return *this;
+        }
+    };
+
+    /// <summary>
+    /// Measures the page faults between construction and stop().
+    /// </summary>
+    class page_fault_counter {
+        long minor;
+        long major;
+
+        static rusage now() {
+            rusage usage{};
+            getrusage(RUSAGE_SELF, &usage);
+            return usage;
+        }
+
+    public:
+        page_fault_counter() {
+            const rusage usage = now();
+            minor = usage.ru_minflt;
+            major = usage.ru_majflt;
+        }
+
+        void stop(memory_stats& stats) const {
+            const rusage usage = now();
+            stats.minorFaults += usage.ru_minflt - minor;
+            stats.majorFaults += usage.ru_majflt - major;
+        }
+    };
+
+    /// <summary>
+    /// Array that only ever grows: reserve() keeps the storage if it is large enough, otherwise replaces it
+    /// (contents are not preserved) and counts the allocation. Grows by at least 1.5x, so slowly growing inputs
+    /// settle after a few rounds.
+    /// </summary>
+    template<typename T>
+    class grow_buffer {
+        T* data_ = nullptr;
+        size_t capacity_ = 0;
+
+    public:
+        grow_buffer() = default;
+        grow_buffer(const grow_buffer&) = delete;
+        grow_buffer& operator=(const grow_buffer&) = delete;
+        ~grow_buffer() { delete[] data_; }
+
+        T* reserve(const size_t n, memory_stats& stats) {
+            if (n > capacity_) {
+                const size_t capacity = n > capacity_ + capacity_ / 2 ? n : capacity_ + capacity_ / 2;
+                delete[] data_;
+                data_ = new T[capacity];
+                capacity_ = capacity;
+                stats.allocations++;
+                stats.allocatedBytes += capacity * sizeof(T);
+            }
+            return data_;
+        }
+
+        T* data() const { return data_; }
+        size_t capacity() const { return capacity_; }
+    };
+
+}
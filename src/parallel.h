@@ -0,0 +1,164 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <cstddef>
+
+namespace experimental {
+
+    inline unsigned int default_thread_count() {
+        const unsigned int n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    /// <summary>
+    /// Runs fn(task) for task = 0..tasks-1 on up to `threads` worker threads. Tasks are handed out dynamically
+    /// from a shared counter, so uneven tasks balance out. Which thread runs a task must not matter for the result.
+    /// The first exception thrown by a task is rethrown on the calling thread.
+    /// </summary>
+    template<typename Fn>
+    void parallel_for(const size_t tasks, const unsigned int threads, Fn fn) {
+        const unsigned int workers = static_cast<unsigned int>(std::min<size_t>(std::max(threads, 1u), tasks));
+        if (workers <= 1) {
+            for (size_t t = 0; t < tasks; t++) { fn(t); }
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+
+        auto work = [&]() {
+            for (size_t t = next++; t < tasks && !failed; t = next++) {
+                try {
+                    fn(t);
+                } catch (...) {
+                    if (!failed.exchange(true)) { error = std::current_exception(); }
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned int i = 0; i < workers - 1; i++) {
+            pool.emplace_back(work);
+        }
+        work();
+
+        for (auto& th : pool) { th.join(); }
+
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    /// <summary>
+    /// parallel_for on threads that are started once and then kept: run() starts workers only if it needs more than
+    /// ever before, so repeated work (e.g. bucketing one timeslice after the other) creates no threads and allocates
+    /// nothing per call. Same task distribution and exception handling as parallel_for. One run() at a time.
+    /// </summary>
+    class worker_pool {
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        // Current job, valid while running > 0: fn is the caller's callable behind a plain pointer, so no job allocates.
+        const void* fn = nullptr;
+        void (*invoke)(const void*, size_t) = nullptr;
+        size_t tasks = 0;
+        unsigned int participants = 0;
+        size_t generation = 0;
+        unsigned int running = 0;
+        bool stopping = false;
+
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+
+        void work() {
+            for (size_t t = next++; t < tasks && !failed; t = next++) {
+                try {
+                    invoke(fn, t);
+                } catch (...) {
+                    if (!failed.exchange(true)) { error = std::current_exception(); }
+                }
+            }
+        }
+
+        void loop(const unsigned int id) {
+            size_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [&] { return stopping || generation != seen; });
+                    if (stopping) { return; }
+                    seen = generation;
+                    if (id >= participants) { continue; }
+                }
+                work();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (--running == 0) { done.notify_one(); }
+                }
+            }
+        }
+
+    public:
+        worker_pool() = default;
+        worker_pool(const worker_pool&) = delete;
+        worker_pool& operator=(const worker_pool&) = delete;
+
+        ~worker_pool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& th : workers) { th.join(); }
+        }
+
+        // Threads started so far, the calling thread not included.
+        size_t size() const { return workers.size(); }
+
+        template<typename Fn>
+        void run(const size_t in_tasks, const unsigned int threads, Fn f) {
+            const unsigned int helpers = static_cast<unsigned int>(std::min<size_t>(std::max(threads, 1u), in_tasks)) - (in_tasks > 0);
+            if (helpers == 0) {
+                for (size_t t = 0; t < in_tasks; t++) { f(t); }
+                return;
+            }
+
+            while (workers.size() < helpers) {
+                const unsigned int id = static_cast<unsigned int>(workers.size());
+                workers.emplace_back([this, id] { loop(id); });
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                fn = &f;
+                invoke = [](const void* g, const size_t t) { (*static_cast<const Fn*>(g))(t); };
+                tasks = in_tasks;
+                participants = helpers;
+                running = helpers;
+                next = 0;
+                failed = false;
+                error = nullptr;
+                generation++;
+            }
+            wake.notify_all();
+            work();
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [&] { return running == 0; });
+            }
+
+            if (error) { std::rethrow_exception(error); }
+        }
+    };
+
+}
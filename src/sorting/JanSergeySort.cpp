@@ -3,6 +3,7 @@
 #include "../datastructures.h"
 #include "../common.h"
 #include "../device.h"
+#include "../layout.h"
 #include "../types.h"
 
 XPU_IMAGE(experimental::JanSergeySortKernel);
@@ -18,7 +19,9 @@ namespace experimental {
         block_scan_t::storage_t temp;
     };
 
-    XPU_KERNEL(JanSergeySort, JanSergeySortSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+    // Body of both layouts, see layout.h.
+    template<typename Layout>
+    XPU_D void janSergeySort(JanSergeySortSmem& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
 
         // +--------------------------------------------------------------------+
         // | Bucket 0             | Bucket 1             | Bucket 2             |
@@ -43,9 +46,10 @@ namespace experimental {
         const bool isFront = (xpu::block_idx::x() % 2) == 0;
         const bool isBack = (xpu::block_idx::x() % 2) == 1;
 
-        // Branch free index computation.
+        // Branch free index computation. The end is exclusive: a side without digis has start == end
+        // (an inclusive end would wrap below zero for an empty front side at index 0).
         const index_t bucketStartIdx = (isFront * startIndex[bucketIdx]) + (isBack * channelSplitIndex[bucketIdx]);
-        const index_t bucketEndIdx = (isFront * (channelSplitIndex[bucketIdx] - 1)) + (isBack * endIndex[bucketIdx]);
+        const index_t bucketEndIdx = (isFront * channelSplitIndex[bucketIdx]) + (isBack * (endIndex[bucketIdx] + 1));
         const index_t threadStart = bucketStartIdx + xpu::thread_idx::x();
 
         // -----------------------------------------------------------------------------------------------------------
@@ -60,11 +64,16 @@ namespace experimental {
         // -----------------------------------------------------------------------------------------------------------
         // 2. Count channels: O(n)
         // -----------------------------------------------------------------------------------------------------------
-        for (int i = threadStart; i <= bucketEndIdx && i < n; i += xpu::block_dim::x()) {
-            xpu::atomic_add_block(&smem.channelOffset[digis[i].channel % 1024], 1);
+        for (index_t i = threadStart; i < bucketEndIdx && i < n; i += xpu::block_dim::x()) {
+            xpu::atomic_add_block(&smem.channelOffset[digis.channel(i) % 1024], 1);
         }
         xpu::barrier();
 
+        /*
+        //
+        // Same bug in the CUB exclusive-sum as in JanSergeySortSingleBlock, and channelRange is not a multiple
+        // of the block size, so the last channels were never scanned. Replaced by the serial loop below.
+        //
         // -----------------------------------------------------------------------------------------------------------
         // 3. Exclusive sum: O(channelCount)
         // -----------------------------------------------------------------------------------------------------------
@@ -88,10 +97,31 @@ namespace experimental {
         //}
         //xpu::barrier();
 
-        if (xpu::thread_idx::x() == 0) {   
-            for (int i = bucketStartIdx; i <= bucketEndIdx; i++) {
-                output[bucketStartIdx + (smem.channelOffset[digis[i].channel % 1024]++)] = digis[i];
+        */
+
+        if (xpu::thread_idx::x() == 0) {
+            // -----------------------------------------------------------------------------------------------------------
+            // 3. Exclusive sum: O(channelCount) -> O(1)
+            // -----------------------------------------------------------------------------------------------------------
+            count_t sum = 0;
+            for (int i = 0; i < channelRange; i++) {
+                const auto tmp = smem.channelOffset[i];
+                smem.channelOffset[i] = sum;
+                sum += tmp;
+            }
+
+            for (index_t i = bucketStartIdx; i < bucketEndIdx; i++) {
+                output[bucketStartIdx + (smem.channelOffset[digis.channel(i) % 1024]++)] = digis.digi(i);
             }
         }
     }
+
+    XPU_KERNEL(JanSergeySort, JanSergeySortSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+        janSergeySort(smem, n, AoSDigis{digis}, startIndex, endIndex, output, channelSplitIndex);
+    }
+
+    // Same with the SoA layout: the histogram phase reads only the channel column.
+    XPU_KERNEL(JanSergeySortSoA, JanSergeySortSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+        janSergeySort(smem, n, digis, startIndex, endIndex, output, channelSplitIndex);
+    }
 }
\ No newline at end of file
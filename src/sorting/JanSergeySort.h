@@ -5,6 +5,7 @@
 #include "../datastructures.h"
 #include "../constants.h"
 #include "../types.h"
+#include "../layout.h"
 
 namespace experimental {
 
@@ -16,7 +17,9 @@ namespace experimental {
 
     struct JanSergeySortKernel{};
     XPU_EXPORT_KERNEL(JanSergeySortKernel, JanSergeySort, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*, const index_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortKernel, JanSergeySortSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*, const index_t*);
 
 }
 
-XPU_BLOCK_SIZE_1D(experimental::JanSergeySort,  experimental::JanSergeySortBlockDimX);
\ No newline at end of file
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySort,  experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSoA,  experimental::JanSergeySortBlockDimX);
\ No newline at end of file
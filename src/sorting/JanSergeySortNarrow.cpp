@@ -0,0 +1,166 @@
+#include <xpu/device.h>
+#include "JanSergeySortNarrow.h"
+#include "../datastructures.h"
+#include "../common.h"
+#include "../device.h"
+#include "../layout.h"
+
+/*******************************************************************************
+ * JanSergeySortParScatter with half the histogram footprint: the channel
+ * counters are 16 bit, packed two per word (shared memory atomics are 32 bit),
+ * so buckets are limited to JanSergeySortNarrowMaxSize digis.
+ *
+ * The block first reduces the bucket's min/max channel, clearing, scanning
+ * and walking the counters is then limited to that range.
+ *
+ * Same output (stable, one block per bucket), benchmarked against it.
+ ******************************************************************************/
+
+XPU_IMAGE(experimental::JanSergeySortNarrowKernel);
+
+namespace experimental {
+
+    constexpr unsigned int counterWords = channelCount / 2;
+
+    // No digi in this tile slot.
+    constexpr unsigned int noChannel = ~0u;
+
+    struct JanSergeySortNarrowSmem {
+        // Counter of channel c in the low (even c) or high (odd c) half of word c / 2.
+        unsigned int channelOffset[counterWords];
+        // Min/max channel per thread, then the channel sums per thread, double buffered for the scan.
+        count_t threadSum[2][JanSergeySortBlockDimX];
+        unsigned int tileChannel[JanSergeySortBlockDimX];
+    };
+
+    static_assert(sizeof(JanSergeySortNarrowSmem) == JanSergeySortNarrowSmemBytes, "JanSergeySortNarrowSmemBytes does not match the shared memory struct");
+
+    XPU_D unsigned int counterShift(const unsigned int channel) { return (channel & 1) * 16; }
+
+    XPU_D unsigned int counter(const unsigned int* words, const unsigned int channel) { return (words[channel >> 1] >> counterShift(channel)) & 0xFFFF; }
+
+    // Body over the read policy of layout.h, like the other kernels.
+    template<typename Layout>
+    XPU_D void janSergeySortNarrow(JanSergeySortNarrowSmem& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        const auto bucketIdx = xpu::block_idx::x();
+        const index_t bucketStartIdx = startIndex[bucketIdx];
+        const index_t bucketEndIdx = endIndex[bucketIdx];
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 0. Channel range of the bucket: O(n/p + log p)
+        // -----------------------------------------------------------------------------------------------------------
+        count_t minChannel = channelCount;
+        count_t maxChannel = 0;
+        for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
+            const count_t channel = digis.channel(i);
+            minChannel = channel < minChannel ? channel : minChannel;
+            maxChannel = channel > maxChannel ? channel : maxChannel;
+        }
+        smem.threadSum[0][xpu::thread_idx::x()] = minChannel;
+        smem.threadSum[1][xpu::thread_idx::x()] = maxChannel;
+        xpu::barrier();
+
+        for (int stride = 1; stride < xpu::block_dim::x(); stride *= 2) {
+            const int other = xpu::thread_idx::x() + stride;
+            if (xpu::thread_idx::x() % (2 * stride) == 0 && other < xpu::block_dim::x()) {
+                smem.threadSum[0][xpu::thread_idx::x()] = smem.threadSum[0][other] < smem.threadSum[0][xpu::thread_idx::x()] ? smem.threadSum[0][other] : smem.threadSum[0][xpu::thread_idx::x()];
+                smem.threadSum[1][xpu::thread_idx::x()] = smem.threadSum[1][other] > smem.threadSum[1][xpu::thread_idx::x()] ? smem.threadSum[1][other] : smem.threadSum[1][xpu::thread_idx::x()];
+            }
+            xpu::barrier();
+        }
+
+        // Word range of the counters in use, empty for an empty bucket (firstWord > lastWord).
+        const unsigned int firstWord = smem.threadSum[0][0] / 2;
+        const unsigned int lastWord = smem.threadSum[1][0] / 2;
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 1. Init the counters of the range to zero: O(range / p)
+        // -----------------------------------------------------------------------------------------------------------
+        for (auto w = firstWord + xpu::thread_idx::x(); w <= lastWord; w += xpu::block_dim::x()) {
+            smem.channelOffset[w] = 0;
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 2. Count channels: O(n/p)
+        // A half never carries into the other, no counter exceeds the bucket size.
+        // -----------------------------------------------------------------------------------------------------------
+        for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
+            const unsigned int channel = digis.channel(i);
+            xpu::atomic_add_block(&smem.channelOffset[channel >> 1], 1u << counterShift(channel));
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 3. Exclusive sum over the range: O(range / p + log p)
+        // As in JanSergeySortParScatter, with contiguous word ranges per thread: both halves of a word are written by
+        // the same thread.
+        // -----------------------------------------------------------------------------------------------------------
+        const unsigned int words = firstWord <= lastWord ? lastWord - firstWord + 1 : 0;
+        const unsigned int wordsPerThread = (words + xpu::block_dim::x() - 1) / xpu::block_dim::x();
+        const unsigned int beginOffset = xpu::thread_idx::x() * wordsPerThread;
+        const unsigned int beginWord = firstWord + (beginOffset < words ? beginOffset : words);
+        const unsigned int endWord = firstWord + (beginOffset + wordsPerThread < words ? beginOffset + wordsPerThread : words);
+
+        count_t rangeSum = 0;
+        for (unsigned int w = beginWord; w < endWord; w++) {
+            rangeSum += (smem.channelOffset[w] & 0xFFFF) + (smem.channelOffset[w] >> 16);
+        }
+        smem.threadSum[0][xpu::thread_idx::x()] = rangeSum;
+        xpu::barrier();
+
+        int in = 0;
+        for (int stride = 1; stride < xpu::block_dim::x(); stride *= 2) {
+            const count_t own = smem.threadSum[in][xpu::thread_idx::x()];
+            smem.threadSum[1 - in][xpu::thread_idx::x()] = xpu::thread_idx::x() >= stride ? own + smem.threadSum[in][xpu::thread_idx::x() - stride] : own;
+            in = 1 - in;
+            xpu::barrier();
+        }
+
+        count_t offset = smem.threadSum[in][xpu::thread_idx::x()] - rangeSum;
+        for (unsigned int w = beginWord; w < endWord; w++) {
+            const count_t low = smem.channelOffset[w] & 0xFFFF;
+            const count_t high = smem.channelOffset[w] >> 16;
+            smem.channelOffset[w] = offset | ((offset + low) << 16);
+            offset += low + high;
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 4. Stable placement in tiles of blockDim digis, as in JanSergeySortParScatter.
+        // Two channels of a word may advance in the same tile, so the offsets move atomically.
+        // -----------------------------------------------------------------------------------------------------------
+        for (index_t tile = bucketStartIdx; tile <= bucketEndIdx; tile += xpu::block_dim::x()) {
+            const index_t i = tile + xpu::thread_idx::x();
+            const bool valid = i <= bucketEndIdx;
+            const unsigned int channel = valid ? digis.channel(i) : noChannel;
+
+            smem.tileChannel[xpu::thread_idx::x()] = channel;
+            xpu::barrier();
+
+            count_t rank = 0;
+            bool last = true;
+            for (int t = 0; t < xpu::block_dim::x(); t++) {
+                if (smem.tileChannel[t] != channel) { continue; }
+                if (t < xpu::thread_idx::x()) { rank++; }
+                if (t > xpu::thread_idx::x()) { last = false; }
+            }
+
+            if (valid) {
+                output[bucketStartIdx + counter(smem.channelOffset, channel) + rank] = digis.digi(i);
+            }
+            // Every thread of the tile has read the offsets before they move on.
+            xpu::barrier();
+
+            if (valid && last) {
+                xpu::atomic_add_block(&smem.channelOffset[channel >> 1], (rank + 1) << counterShift(channel));
+            }
+            xpu::barrier();
+        }
+    }
+
+    XPU_KERNEL(JanSergeySortNarrow, JanSergeySortNarrowSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortNarrow(smem, n, AoSDigis{digis}, startIndex, endIndex, output);
+    }
+}
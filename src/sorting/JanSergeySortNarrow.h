@@ -0,0 +1,26 @@
+#pragma once
+
+#include <xpu/device.h>
+#include <cstddef>
+#include "../datastructures.h"
+#include "../constants.h"
+#include "../types.h"
+
+namespace experimental {
+
+    // Largest bucket JanSergeySortNarrow can sort: its channel counters and offsets are 16 bit.
+    constexpr index_t JanSergeySortNarrowMaxSize = 0xFFFF;
+
+    // Shared memory of the channel counters per block, against channelCount * sizeof(count_t) in the other kernels.
+    constexpr size_t JanSergeySortNarrowHistogramBytes = channelCount / 2 * sizeof(unsigned int);
+
+    // All shared memory per block: the counters, plus the scan sums (two per thread) and the tile's channels (one per thread).
+    constexpr size_t JanSergeySortNarrowSmemBytes = JanSergeySortNarrowHistogramBytes + 2 * JanSergeySortBlockDimX * sizeof(count_t) + JanSergeySortBlockDimX * sizeof(unsigned int);
+
+    struct JanSergeySortNarrowKernel{};
+    // Same arguments as JanSergeySortParScatter, for buckets of at most JanSergeySortNarrowMaxSize digis.
+    XPU_EXPORT_KERNEL(JanSergeySortNarrowKernel, JanSergeySortNarrow, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*);
+
+}
+
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortNarrow, experimental::JanSergeySortBlockDimX);
@@ -3,6 +3,7 @@
 #include "../datastructures.h"
 #include "../common.h"
 #include "../device.h"
+#include "../layout.h"
 
 XPU_IMAGE(experimental::JanSergeySortParInsertKernel);
 
@@ -15,7 +16,9 @@ namespace experimental {
         count_t channelOffset[channelRange];
     };
 
-    XPU_KERNEL(JanSergeySortParInsert, JanSergeySortParInsertSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+    // Body of both layouts, see layout.h.
+    template<typename Layout>
+    XPU_D void janSergeySortParInsert(JanSergeySortParInsertSmem& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
         // +--------------------------------------------------------------------+
         // | Bucket 0             | Bucket 1             | Bucket 2             |
         // +---------+------------+---------+------------+---------+------------+
@@ -34,9 +37,9 @@ namespace experimental {
         const bool isFront = (xpu::block_idx::x() % 2) == 0;
         const bool isBack = (xpu::block_idx::x() % 2) == 1;
 
-        // Multiply instead of "if".
+        // Multiply instead of "if". Exclusive end, so an empty side (start == end) cannot wrap.
         const uint_t bucketStartIdx = (isFront * startIndex[bucketIdx]) + (isBack * channelSplitIndex[bucketIdx]);
-        const uint_t bucketEndIdx = (isFront * (channelSplitIndex[bucketIdx] - 1)) + (isBack * endIndex[bucketIdx]);
+        const uint_t bucketEndIdx = (isFront * channelSplitIndex[bucketIdx]) + (isBack * (endIndex[bucketIdx] + 1));
         const uint_t threadStart = bucketStartIdx + xpu::thread_idx::x();
 
         // -----------------------------------------------------------------------------------------------------------
@@ -51,8 +54,8 @@ namespace experimental {
         // -----------------------------------------------------------------------------------------------------------
         // 2. Count channels: O(n)
         // -----------------------------------------------------------------------------------------------------------
-        for (int i = threadStart; i <= bucketEndIdx && i < n; i += xpu::block_dim::x()) {
-            xpu::atomic_add_block(&smem.channelOffset[digis[i].channel % 1024], 1);
+        for (uint_t i = threadStart; i < bucketEndIdx && i < n; i += xpu::block_dim::x()) {
+            xpu::atomic_add_block(&smem.channelOffset[digis.channel(i) % 1024], 1);
         }
         xpu::barrier();
 
@@ -67,9 +70,18 @@ namespace experimental {
                 sum += tmp;
             }
 
-            for (int i = bucketStartIdx; i <= bucketEndIdx; i++) {
-                output[bucketStartIdx + (smem.channelOffset[digis[i].channel % 1024]++)] = digis[i];
+            for (uint_t i = bucketStartIdx; i < bucketEndIdx; i++) {
+                output[bucketStartIdx + (smem.channelOffset[digis.channel(i) % 1024]++)] = digis.digi(i);
             }
         }
     }
+
+    XPU_KERNEL(JanSergeySortParInsert, JanSergeySortParInsertSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+        janSergeySortParInsert(smem, n, AoSDigis{digis}, startIndex, endIndex, output, channelSplitIndex);
+    }
+
+    // Same with the SoA layout: the histogram phase reads only the channel column.
+    XPU_KERNEL(JanSergeySortParInsertSoA, JanSergeySortParInsertSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+        janSergeySortParInsert(smem, n, digis, startIndex, endIndex, output, channelSplitIndex);
+    }
 }
\ No newline at end of file
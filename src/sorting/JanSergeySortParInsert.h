@@ -4,12 +4,15 @@
 #include "../datastructures.h"
 #include "../constants.h"
 #include "../types.h"
+#include "../layout.h"
 
 namespace experimental {
 
     struct JanSergeySortParInsertKernel{};
     XPU_EXPORT_KERNEL(JanSergeySortParInsertKernel, JanSergeySortParInsert, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*, const index_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortParInsertKernel, JanSergeySortParInsertSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*, const index_t*);
 
 }
 
-XPU_BLOCK_SIZE_1D(experimental::JanSergeySortParInsert,  experimental::JanSergeySortBlockDimX);
\ No newline at end of file
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortParInsert,  experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortParInsertSoA,  experimental::JanSergeySortBlockDimX);
\ No newline at end of file
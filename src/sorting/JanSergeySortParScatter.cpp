@@ -0,0 +1,186 @@
+#include <xpu/device.h>
+#include "JanSergeySortParScatter.h"
+#include "../datastructures.h"
+#include "../common.h"
+#include "../device.h"
+#include "../layout.h"
+
+/*******************************************************************************
+ * JanSergeySortSingleBlock with all phases parallel: the exclusive sum and the
+ * placement no longer run on thread 0 alone while the rest of the block waits.
+ *
+ * JanSergeySortWarpHistogram additionally counts into one sub-histogram per
+ * warp, so hot channels do not serialize the whole block on one counter.
+ *
+ * Same output (stable, one block per bucket), benchmarked against it.
+ ******************************************************************************/
+
+XPU_IMAGE(experimental::JanSergeySortParScatterKernel);
+
+namespace experimental {
+
+    // No digi in this tile slot.
+    constexpr unsigned int noChannel = ~0u;
+
+    constexpr int warpsPerBlock = JanSergeySortBlockDimX / WarpSize;
+
+    // Histograms: sub-histograms counted into, reduced into the first one, which then holds the offsets.
+    template<int Histograms>
+    struct JanSergeySortParScatterSmemT {
+        count_t channelOffset[Histograms][channelCount];
+        // Channel sums per thread, double buffered for the scan.
+        count_t threadSum[2][JanSergeySortBlockDimX];
+        unsigned int tileChannel[JanSergeySortBlockDimX];
+    };
+
+    using JanSergeySortParScatterSmem = JanSergeySortParScatterSmemT<1>;
+    using JanSergeySortWarpHistogramSmem = JanSergeySortParScatterSmemT<warpsPerBlock>;
+
+    static_assert(sizeof(JanSergeySortParScatterSmem) == JanSergeySortParScatterSmemBytes, "JanSergeySortParScatterSmemBytes does not match the shared memory struct");
+
+    // Body of both layouts (see layout.h) and both histogram modes.
+    template<typename Layout, int Histograms>
+    XPU_D void janSergeySortParScatter(JanSergeySortParScatterSmemT<Histograms>& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        const auto bucketIdx = xpu::block_idx::x();
+        const index_t bucketStartIdx = startIndex[bucketIdx];
+        const index_t bucketEndIdx = endIndex[bucketIdx];
+
+        // Contiguous channel range per thread in the scan. From the launched block size: the CPU driver runs one thread
+        // per block, the shared arrays are sized for JanSergeySortBlockDimX threads at most.
+        const unsigned int channelsPerThread = (channelCount + xpu::block_dim::x() - 1) / xpu::block_dim::x();
+        const unsigned int firstChannel = xpu::thread_idx::x() * channelsPerThread < channelCount ? xpu::thread_idx::x() * channelsPerThread : channelCount;
+        const unsigned int lastChannel = firstChannel + channelsPerThread < channelCount ? firstChannel + channelsPerThread : channelCount;
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 1. Init all channel counters to zero: O(Histograms * channelCount / p)
+        // -----------------------------------------------------------------------------------------------------------
+        for (int h = 0; h < Histograms; h++) {
+            for (auto i = xpu::thread_idx::x(); i < channelCount; i += xpu::block_dim::x()) {
+                smem.channelOffset[h][i] = 0;
+            }
+        }
+        xpu::barrier();
+
+        if constexpr (Histograms == 1) {
+            // -------------------------------------------------------------------------------------------------------
+            // Phase 2. Count channels: O(n/p)
+            // -------------------------------------------------------------------------------------------------------
+            for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
+                xpu::atomic_add_block(&smem.channelOffset[0][digis.channel(i)], 1);
+            }
+            xpu::barrier();
+        } else {
+            // -------------------------------------------------------------------------------------------------------
+            // Phase 2. Count channels into the warp's sub-histogram: O(n/p)
+            // Each thread also adds up runs of the same channel in its own digis before it touches shared memory,
+            // so a hot channel costs one atomic per run instead of one per digi.
+            // -------------------------------------------------------------------------------------------------------
+            count_t* histogram = smem.channelOffset[xpu::thread_idx::x() / WarpSize];
+
+            unsigned int runChannel = noChannel;
+            count_t run = 0;
+            for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
+                const unsigned int channel = digis.channel(i);
+                if (channel != runChannel) {
+                    if (run > 0) { xpu::atomic_add_block(&histogram[runChannel], run); }
+                    runChannel = channel;
+                    run = 0;
+                }
+                run++;
+            }
+            if (run > 0) { xpu::atomic_add_block(&histogram[runChannel], run); }
+            xpu::barrier();
+
+            // -------------------------------------------------------------------------------------------------------
+            // Phase 2b. Reduce the sub-histograms into the first one: O(Histograms * channelCount / p)
+            // -------------------------------------------------------------------------------------------------------
+            for (auto c = xpu::thread_idx::x(); c < channelCount; c += xpu::block_dim::x()) {
+                count_t sum = smem.channelOffset[0][c];
+                for (int h = 1; h < Histograms; h++) {
+                    sum += smem.channelOffset[h][c];
+                }
+                smem.channelOffset[0][c] = sum;
+            }
+            xpu::barrier();
+        }
+
+        count_t* channelOffset = smem.channelOffset[0];
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 3. Exclusive sum: O(channelCount / p + log p)
+        // Each thread sums its channel range, the thread sums are scanned (Hillis-Steele, inclusive), then each thread
+        // writes the offsets of its range starting at the sum of the ranges before it.
+        // -----------------------------------------------------------------------------------------------------------
+        count_t rangeSum = 0;
+        for (unsigned int c = firstChannel; c < lastChannel; c++) {
+            rangeSum += channelOffset[c];
+        }
+        smem.threadSum[0][xpu::thread_idx::x()] = rangeSum;
+        xpu::barrier();
+
+        int in = 0;
+        for (int stride = 1; stride < xpu::block_dim::x(); stride *= 2) {
+            const count_t own = smem.threadSum[in][xpu::thread_idx::x()];
+            smem.threadSum[1 - in][xpu::thread_idx::x()] = xpu::thread_idx::x() >= stride ? own + smem.threadSum[in][xpu::thread_idx::x() - stride] : own;
+            in = 1 - in;
+            xpu::barrier();
+        }
+
+        count_t offset = smem.threadSum[in][xpu::thread_idx::x()] - rangeSum;
+        for (unsigned int c = firstChannel; c < lastChannel; c++) {
+            const count_t count = channelOffset[c];
+            channelOffset[c] = offset;
+            offset += count;
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 4. Stable placement in tiles of blockDim digis: O(n/p * p) compares, but no serial global accesses.
+        // A digi's rank among the digis of its channel earlier in the tile gives its position after the ones of the
+        // previous tiles. The last digi of a channel in the tile advances the channel's offset.
+        // -----------------------------------------------------------------------------------------------------------
+        for (index_t tile = bucketStartIdx; tile <= bucketEndIdx; tile += xpu::block_dim::x()) {
+            const index_t i = tile + xpu::thread_idx::x();
+            const bool valid = i <= bucketEndIdx;
+            const unsigned int channel = valid ? digis.channel(i) : noChannel;
+
+            smem.tileChannel[xpu::thread_idx::x()] = channel;
+            xpu::barrier();
+
+            count_t rank = 0;
+            bool last = true;
+            for (int t = 0; t < xpu::block_dim::x(); t++) {
+                if (smem.tileChannel[t] != channel) { continue; }
+                if (t < xpu::thread_idx::x()) { rank++; }
+                if (t > xpu::thread_idx::x()) { last = false; }
+            }
+
+            if (valid) {
+                output[bucketStartIdx + channelOffset[channel] + rank] = digis.digi(i);
+            }
+            // Every thread of the tile has read the offsets before they move on.
+            xpu::barrier();
+
+            if (valid && last) {
+                channelOffset[channel] += rank + 1;
+            }
+            xpu::barrier();
+        }
+    }
+
+    XPU_KERNEL(JanSergeySortParScatter, JanSergeySortParScatterSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortParScatter(smem, n, AoSDigis{digis}, startIndex, endIndex, output);
+    }
+
+    XPU_KERNEL(JanSergeySortParScatterSoA, JanSergeySortParScatterSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortParScatter(smem, n, digis, startIndex, endIndex, output);
+    }
+
+    XPU_KERNEL(JanSergeySortWarpHistogram, JanSergeySortWarpHistogramSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortParScatter(smem, n, AoSDigis{digis}, startIndex, endIndex, output);
+    }
+
+    XPU_KERNEL(JanSergeySortWarpHistogramSoA, JanSergeySortWarpHistogramSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortParScatter(smem, n, digis, startIndex, endIndex, output);
+    }
+}
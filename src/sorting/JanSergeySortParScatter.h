@@ -0,0 +1,29 @@
+#pragma once
+
+#include <xpu/device.h>
+#include <cstddef>
+#include "../datastructures.h"
+#include "../constants.h"
+#include "../types.h"
+#include "../layout.h"
+
+namespace experimental {
+
+    // All shared memory per block of JanSergeySortParScatter: the channel counters, plus the scan sums (two per thread)
+    // and the tile's channels (one per thread). JanSergeySortWarpHistogram has one set of counters per warp.
+    constexpr size_t JanSergeySortParScatterSmemBytes = channelCount * sizeof(count_t) + 2 * JanSergeySortBlockDimX * sizeof(count_t) + JanSergeySortBlockDimX * sizeof(unsigned int);
+
+    struct JanSergeySortParScatterKernel{};
+    XPU_EXPORT_KERNEL(JanSergeySortParScatterKernel, JanSergeySortParScatter, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortParScatterKernel, JanSergeySortParScatterSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*);
+
+    // Same, counting into one sub-histogram per warp (reduced before the scan).
+    XPU_EXPORT_KERNEL(JanSergeySortParScatterKernel, JanSergeySortWarpHistogram, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortParScatterKernel, JanSergeySortWarpHistogramSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*);
+
+}
+
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortParScatter, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortParScatterSoA, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortWarpHistogram, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortWarpHistogramSoA, experimental::JanSergeySortBlockDimX);
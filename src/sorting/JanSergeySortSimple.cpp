@@ -3,6 +3,7 @@
 #include "../datastructures.h"
 #include "../common.h"
 #include "../device.h"
+#include "../layout.h"
 
 /*******************************************************************************
  * This kernel is called "simple" because it runs only one thread-block per
@@ -19,7 +20,9 @@ namespace experimental {
         count_t channelOffset[channelCount];
     };
 
-    XPU_KERNEL(JanSergeySortSimple, JanSergeySortSimpleSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, const index_t* channelSplitIndex) {
+    // Body of both layouts, see layout.h.
+    template<typename Layout>
+    XPU_D void janSergeySortSimple(JanSergeySortSimpleSmem& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
         const index_t bucketIdx = xpu::block_idx::x();
         const index_t bucketStartIdx = startIndex[bucketIdx];
         const index_t bucketEndIdx = endIndex[bucketIdx];
@@ -39,7 +42,7 @@ namespace experimental {
         const index_t threadStart = bucketStartIdx + xpu::thread_idx::x();
 
         for (index_t i = threadStart; i <= bucketEndIdx && i < n; i += xpu::block_dim::x()) {
-            xpu::atomic_add_block(&smem.channelOffset[digis[i].channel], 1);
+            xpu::atomic_add_block(&smem.channelOffset[digis.channel(i)], 1);
         }
         xpu::barrier();   
 
@@ -61,8 +64,17 @@ namespace experimental {
             // a digis into the same channel as a thread on the left. Might be handled by some algoritm, unclear yet.
             // -----------------------------------------------------------------------------------------------------------
             for (index_t i = bucketStartIdx; i <= bucketEndIdx; i++) {
-                output[bucketStartIdx + (smem.channelOffset[digis[i].channel]++)] = digis[i];
+                output[bucketStartIdx + (smem.channelOffset[digis.channel(i)]++)] = digis.digi(i);
             }
         }
     }
+
+    XPU_KERNEL(JanSergeySortSimple, JanSergeySortSimpleSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortSimple(smem, n, AoSDigis{digis}, startIndex, endIndex, output);
+    }
+
+    // Same with the SoA layout: the histogram phase reads only the channel column.
+    XPU_KERNEL(JanSergeySortSimpleSoA, JanSergeySortSimpleSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortSimple(smem, n, digis, startIndex, endIndex, output);
+    }
 }
\ No newline at end of file
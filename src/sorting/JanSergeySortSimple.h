@@ -5,12 +5,15 @@
 #include "../datastructures.h"
 #include "../constants.h"
 #include "../types.h"
+#include "../layout.h"
 
 namespace experimental {
 
     struct JanSergeySortSimpleKernel{};
-    XPU_EXPORT_KERNEL(JanSergeySortSimpleKernel, JanSergeySortSimple, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*, const index_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortSimpleKernel, JanSergeySortSimple, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortSimpleKernel, JanSergeySortSimpleSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*);
 
 }
 
 XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSimple, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSimpleSoA, experimental::JanSergeySortBlockDimX);
@@ -3,6 +3,7 @@
 #include "../datastructures.h"
 #include "../common.h"
 #include "../device.h"
+#include "../layout.h"
 
 XPU_IMAGE(experimental::JanSergeySortSingleBlockKernel);
 
@@ -18,7 +19,9 @@ namespace experimental {
         block_scan_t::storage_t temp;
     };
 
-    XPU_KERNEL(JanSergeySortSingleBlock, JanSergeySortSingleBlockSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+    // Body of both layouts, see layout.h.
+    template<typename Layout>
+    XPU_D void janSergeySortSingleBlock(JanSergeySortSingleBlockSmem& smem, const size_t n, const Layout digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
         const auto bucketIdx = xpu::block_idx::x();
         const index_t bucketStartIdx = startIndex[bucketIdx];
         const index_t bucketEndIdx = endIndex[bucketIdx];
@@ -37,7 +40,7 @@ namespace experimental {
         // Phase 2. Count channels: O(n/p)
         // -----------------------------------------------------------------------------------------------------------       
         for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
-            xpu::atomic_add_block(&smem.channelOffset[digis[i].channel], 1);
+            xpu::atomic_add_block(&smem.channelOffset[digis.channel(i)], 1);
         }
         xpu::barrier();
 
@@ -86,7 +89,75 @@ namespace experimental {
             }
 
             for (auto i = bucketStartIdx; i <= bucketEndIdx; i++) {
-                output[bucketStartIdx + (smem.channelOffset[digis[i].channel]++)] = digis[i];
+                output[bucketStartIdx + (smem.channelOffset[digis.channel(i)]++)] = digis.digi(i);
+            }
+        }
+    }
+
+    XPU_KERNEL(JanSergeySortSingleBlock, JanSergeySortSingleBlockSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortSingleBlock(smem, n, AoSDigis{digis}, startIndex, endIndex, output);
+    }
+
+    // Same with the SoA layout: the histogram phase reads only the channel column.
+    XPU_KERNEL(JanSergeySortSingleBlockSoA, JanSergeySortSingleBlockSmem, const size_t n, const SoADigis digis, const index_t* startIndex, const index_t* endIndex, digi_t* output) {
+        janSergeySortSingleBlock(smem, n, digis, startIndex, endIndex, output);
+    }
+
+    /// <summary>
+    /// JanSergeySortSingleBlock plus the channel statistics of each bucket, written to the bucket's row of channelCount
+    /// entries. The counts are the histogram of phase 2, charge sum and min/max time are gathered in the serial placement
+    /// loop, which reads every digi anyway. No extra pass over the data and no extra atomics.
+    /// chargeSum, minTime and maxTime are optional (nullptr). Channels without digis have minTime > maxTime.
+    /// </summary>
+    XPU_KERNEL(JanSergeySortSingleBlockStats, JanSergeySortSingleBlockSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, digi_t* output, count_t* channelCounts, unsigned long long* chargeSum, unsigned int* minTime, unsigned int* maxTime) {
+        const auto bucketIdx = xpu::block_idx::x();
+        const index_t bucketStartIdx = startIndex[bucketIdx];
+        const index_t bucketEndIdx = endIndex[bucketIdx];
+        const size_t row = size_t(bucketIdx) * channelCount;
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 1. Init all channel counters and the bucket's statistics row: O(channelCount) = O(1)
+        // -----------------------------------------------------------------------------------------------------------
+        for (auto i = xpu::thread_idx::x(); i < channelCount; i += xpu::block_dim::x()) {
+            smem.channelOffset[i] = 0;
+            if (chargeSum != nullptr) { chargeSum[row + i] = 0; }
+            if (minTime != nullptr) { minTime[row + i] = ~0u; }
+            if (maxTime != nullptr) { maxTime[row + i] = 0; }
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 2. Count channels: O(n/p)
+        // -----------------------------------------------------------------------------------------------------------
+        for (auto i = bucketStartIdx + xpu::thread_idx::x(); i <= bucketEndIdx; i += xpu::block_dim::x()) {
+            xpu::atomic_add_block(&smem.channelOffset[digis[i].channel], 1);
+        }
+        xpu::barrier();
+
+        // The histogram is final here, before the exclusive sum overwrites it.
+        for (auto i = xpu::thread_idx::x(); i < channelCount; i += xpu::block_dim::x()) {
+            channelCounts[row + i] = smem.channelOffset[i];
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 3 and 4. Exclusive sum and placement by thread 0 (see JanSergeySortSingleBlock), statistics on the way.
+        // -----------------------------------------------------------------------------------------------------------
+        if (xpu::thread_idx::x() == 0) {
+            count_t sum = 0;
+            for (int i = 0; i < channelCount; i++) {
+                const auto tmp = smem.channelOffset[i];
+                smem.channelOffset[i] = sum;
+                sum += tmp;
+            }
+
+            for (auto i = bucketStartIdx; i <= bucketEndIdx; i++) {
+                const digi_t digi = digis[i];
+                output[bucketStartIdx + (smem.channelOffset[digi.channel]++)] = digi;
+
+                if (chargeSum != nullptr) { chargeSum[row + digi.channel] += digi.charge; }
+                if (minTime != nullptr && digi.time < minTime[row + digi.channel]) { minTime[row + digi.channel] = digi.time; }
+                if (maxTime != nullptr && digi.time > maxTime[row + digi.channel]) { maxTime[row + digi.channel] = digi.time; }
             }
         }
     }
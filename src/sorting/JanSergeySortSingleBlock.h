@@ -5,12 +5,20 @@
 #include "../datastructures.h"
 #include "../constants.h"
 #include "../types.h"
+#include "../layout.h"
 
 namespace experimental {
 
     struct JanSergeySortSingleBlockKernel{};
     XPU_EXPORT_KERNEL(JanSergeySortSingleBlockKernel, JanSergeySortSingleBlock, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*);
+    XPU_EXPORT_KERNEL(JanSergeySortSingleBlockKernel, JanSergeySortSingleBlockSoA, const size_t, const SoADigis, const index_t*, const index_t*, digi_t*);
+
+    // Same sort, additionally exports the channel histogram of every bucket (row of channelCount per bucket):
+    // digi count, and if the pointers are not null, charge sum and min/max time per channel.
+    XPU_EXPORT_KERNEL(JanSergeySortSingleBlockKernel, JanSergeySortSingleBlockStats, const size_t, const digi_t*, const index_t*, const index_t*, digi_t*, count_t*, unsigned long long*, unsigned int*, unsigned int*);
 
 }
 
 XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSingleBlock, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSingleBlockSoA, experimental::JanSergeySortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSingleBlockStats, experimental::JanSergeySortBlockDimX);
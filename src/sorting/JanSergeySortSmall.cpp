@@ -0,0 +1,65 @@
+#include <xpu/device.h>
+#include "JanSergeySortSmall.h"
+#include "../datastructures.h"
+#include "../common.h"
+#include "../device.h"
+
+/*******************************************************************************
+ * Sort of buckets with at most WarpSize digis, without the channel histogram.
+ *
+ * Every warp sorts one bucket, each lane holds one digi and computes its
+ * final position directly: the number of digis in the bucket with a smaller
+ * channel, or the same channel and a smaller input position.
+ * O(size) per lane, but no channelCount counters to clear, scan and walk.
+ * With fewer threads per block (the CPU driver runs one), each thread takes
+ * several of these slots in turn.
+ *
+ * Same output as the ConcatSort kernels (stable), for the small buckets only.
+ ******************************************************************************/
+
+XPU_IMAGE(experimental::JanSergeySortSmallKernel);
+
+namespace experimental {
+
+    struct JanSergeySortSmallSmem {
+        // Channels of the bucket of each warp.
+        unsigned short channel[JanSergeySortSmallBucketsPerBlock][JanSergeySortSmallMaxSize];
+    };
+
+    XPU_KERNEL(JanSergeySortSmall, JanSergeySortSmallSmem, const size_t n, const digi_t* digis, const index_t* startIndex, const index_t* endIndex, const count_t buckets, digi_t* output) {
+        // One slot per (bucket of the block, digi of the bucket), a warp's worth per bucket.
+        constexpr int slots = JanSergeySortSmallBucketsPerBlock * JanSergeySortSmallMaxSize;
+
+        // The last block may have slots without a bucket, their threads still take part in the barrier.
+        for (int s = xpu::thread_idx::x(); s < slots; s += xpu::block_dim::x()) {
+            const int warp = s / JanSergeySortSmallMaxSize;
+            const index_t lane = s % JanSergeySortSmallMaxSize;
+            const count_t bucketIdx = xpu::block_idx::x() * JanSergeySortSmallBucketsPerBlock + warp;
+
+            if (bucketIdx < buckets && lane < endIndex[bucketIdx] + 1 - startIndex[bucketIdx]) {
+                smem.channel[warp][lane] = digis[startIndex[bucketIdx] + lane].channel;
+            }
+        }
+        xpu::barrier();
+
+        for (int s = xpu::thread_idx::x(); s < slots; s += xpu::block_dim::x()) {
+            const int warp = s / JanSergeySortSmallMaxSize;
+            const index_t lane = s % JanSergeySortSmallMaxSize;
+            const count_t bucketIdx = xpu::block_idx::x() * JanSergeySortSmallBucketsPerBlock + warp;
+            if (bucketIdx >= buckets) { continue; }
+
+            const index_t bucketStartIdx = startIndex[bucketIdx];
+            const index_t size = endIndex[bucketIdx] + 1 - bucketStartIdx;
+            if (lane >= size) { continue; }
+
+            const digi_t digi = digis[bucketStartIdx + lane];
+            index_t rank = 0;
+            for (index_t j = 0; j < size; j++) {
+                const unsigned short channel = smem.channel[warp][j];
+                rank += channel < digi.channel || (channel == digi.channel && j < lane);
+            }
+            output[bucketStartIdx + rank] = digi;
+        }
+    }
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <xpu/device.h>
+#include <cstddef>
+#include "../datastructures.h"
+#include "../constants.h"
+#include "../types.h"
+
+namespace experimental {
+
+    // Buckets per block of JanSergeySortSmall, one per warp.
+    constexpr int JanSergeySortSmallBucketsPerBlock = JanSergeySortBlockDimX / WarpSize;
+
+    // Largest bucket JanSergeySortSmall can sort: one digi per lane.
+    constexpr int JanSergeySortSmallMaxSize = WarpSize;
+
+    struct JanSergeySortSmallKernel{};
+    // (n, digis, startIndex, endIndex, bucket count, output): the buckets are a list of small buckets only,
+    // launched with (count + JanSergeySortSmallBucketsPerBlock - 1) / JanSergeySortSmallBucketsPerBlock blocks.
+    XPU_EXPORT_KERNEL(JanSergeySortSmallKernel, JanSergeySortSmall, const size_t, const digi_t*, const index_t*, const index_t*, const count_t, digi_t*);
+
+}
+
+XPU_BLOCK_SIZE_1D(experimental::JanSergeySortSmall, experimental::JanSergeySortBlockDimX);
@@ -0,0 +1,230 @@
+#include <xpu/device.h>
+#include "SegmentedSort.h"
+#include "../datastructures.h"
+#include "../common.h"
+#include "../device.h"
+
+/*******************************************************************************
+ * ConcatSort over a work plan (see CbmStsDigiWorkPlan), so that the launch
+ * time no longer follows the largest bucket:
+ *
+ * SegmentedSortPacked: several small buckets per block, one digi per slot
+ * (one slot per thread at full block size), ranked within its bucket as in
+ * JanSergeySortSmall.
+ *
+ * Larger buckets are cut into chunks of equal size, sorted by cooperating
+ * blocks in four launches:
+ *  1. SegmentedSortCount: channel histogram per chunk.
+ *  2. SegmentedSortScanChunks: per group of chunks, exclusive sum over the
+ *     chunks of the group for every channel, plus the group totals.
+ *  3. SegmentedSortScan: per bucket, exclusive sum over (channel, group) of
+ *     the group totals, so the digis of a channel keep the order of the chunks.
+ *  4. SegmentedSortScatter: per chunk, adds its group's positions to its own
+ *     and places its digis stably.
+ *
+ * Same output as the ConcatSort kernels (stable).
+ ******************************************************************************/
+
+XPU_IMAGE(experimental::SegmentedSortKernel);
+
+namespace experimental {
+
+    // No digi in this slot.
+    constexpr unsigned int noChannel = ~0u;
+
+    struct SegmentedSortPackedSmem {
+        // Bucket (within the block) and channel of every slot.
+        count_t slotBucket[SegmentedSortBlockDimX];
+        unsigned int slotChannel[SegmentedSortBlockDimX];
+    };
+
+    XPU_KERNEL(SegmentedSortPacked, SegmentedSortPackedSmem, const size_t n, const digi_t* digis, const index_t* smallStart, const index_t* smallEnd, const index_t* smallSlot, const count_t* packedFirst, digi_t* output) {
+        const count_t first = packedFirst[xpu::block_idx::x()];
+        const count_t buckets = packedFirst[xpu::block_idx::x() + 1] - first;
+        // Every packed block holds at least one bucket, the last one ends the used slots.
+        const count_t last = first + buckets - 1;
+        const index_t used = smallSlot[last] + (smallEnd[last] + 1 - smallStart[last]);
+
+        // One slot per thread at full block size, with fewer threads (the CPU driver runs one) each thread takes
+        // every block_dim-th slot.
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 1. Slots of each bucket: O(bucket size)
+        // -----------------------------------------------------------------------------------------------------------
+        for (auto bucket = xpu::thread_idx::x(); bucket < buckets; bucket += xpu::block_dim::x()) {
+            const count_t b = first + bucket;
+            const index_t size = smallEnd[b] + 1 - smallStart[b];
+            for (index_t s = smallSlot[b]; s < smallSlot[b] + size; s++) {
+                smem.slotBucket[s] = bucket;
+            }
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 2. Load the channel of every slot.
+        // -----------------------------------------------------------------------------------------------------------
+        for (index_t slot = xpu::thread_idx::x(); slot < SegmentedSortBlockDimX; slot += xpu::block_dim::x()) {
+            unsigned int channel = noChannel;
+            if (slot < used) {
+                const count_t b = first + smem.slotBucket[slot];
+                channel = digis[smallStart[b] + slot - smallSlot[b]].channel;
+            }
+            smem.slotChannel[slot] = channel;
+        }
+        xpu::barrier();
+
+        // -----------------------------------------------------------------------------------------------------------
+        // Phase 3. Rank within the bucket: O(bucket size)
+        // -----------------------------------------------------------------------------------------------------------
+        for (index_t slot = xpu::thread_idx::x(); slot < used; slot += xpu::block_dim::x()) {
+            const count_t b = first + smem.slotBucket[slot];
+            const index_t bucketSlot = smallSlot[b];
+            const index_t size = smallEnd[b] + 1 - smallStart[b];
+            const digi_t digi = digis[smallStart[b] + slot - bucketSlot];
+
+            index_t rank = 0;
+            for (index_t s = bucketSlot; s < bucketSlot + size; s++) {
+                const unsigned int channel = smem.slotChannel[s];
+                rank += channel < digi.channel || (channel == digi.channel && s < slot);
+            }
+            output[smallStart[b] + rank] = digi;
+        }
+    }
+
+    struct SegmentedSortCountSmem {
+        count_t channelCounter[channelCount];
+    };
+
+    XPU_KERNEL(SegmentedSortCount, SegmentedSortCountSmem, const size_t n, const digi_t* digis, const index_t* chunkStart, const index_t* chunkEnd, count_t* chunkOffset) {
+        const index_t start = chunkStart[xpu::block_idx::x()];
+        const index_t end = chunkEnd[xpu::block_idx::x()];
+
+        for (auto c = xpu::thread_idx::x(); c < channelCount; c += xpu::block_dim::x()) {
+            smem.channelCounter[c] = 0;
+        }
+        xpu::barrier();
+
+        for (auto i = start + xpu::thread_idx::x(); i <= end; i += xpu::block_dim::x()) {
+            xpu::atomic_add_block(&smem.channelCounter[digis[i].channel], 1);
+        }
+        xpu::barrier();
+
+        count_t* counts = chunkOffset + size_t(xpu::block_idx::x()) * channelCount;
+        for (auto c = xpu::thread_idx::x(); c < channelCount; c += xpu::block_dim::x()) {
+            counts[c] = smem.channelCounter[c];
+        }
+    }
+
+    struct SegmentedSortScanChunksSmem {};
+
+    XPU_KERNEL(SegmentedSortScanChunks, SegmentedSortScanChunksSmem, const count_t* groupFirstChunk, count_t* chunkOffset, count_t* groupOffset) {
+        const count_t firstChunk = groupFirstChunk[xpu::block_idx::x()];
+        const count_t endChunk = groupFirstChunk[xpu::block_idx::x() + 1];
+
+        // One channel per thread, the rows of a group are read and written coalesced.
+        for (auto c = xpu::thread_idx::x(); c < channelCount; c += xpu::block_dim::x()) {
+            count_t sum = 0;
+            for (count_t k = firstChunk; k < endChunk; k++) {
+                count_t& counter = chunkOffset[size_t(k) * channelCount + c];
+                const count_t count = counter;
+                counter = sum;
+                sum += count;
+            }
+            groupOffset[size_t(xpu::block_idx::x()) * channelCount + c] = sum;
+        }
+    }
+
+    struct SegmentedSortScanSmem {
+        // Channel sums per thread, double buffered for the scan.
+        count_t threadSum[2][SegmentedSortBlockDimX];
+    };
+
+    XPU_KERNEL(SegmentedSortScan, SegmentedSortScanSmem, const index_t* segmentStart, const count_t* segmentFirstGroup, count_t* groupOffset) {
+        const index_t start = segmentStart[xpu::block_idx::x()];
+        const count_t firstGroup = segmentFirstGroup[xpu::block_idx::x()];
+        const count_t endGroup = segmentFirstGroup[xpu::block_idx::x() + 1];
+
+        // Contiguous channel range per thread, from the launched block size: the CPU driver runs one thread per block.
+        const unsigned int channelsPerThread = (channelCount + xpu::block_dim::x() - 1) / xpu::block_dim::x();
+        const unsigned int firstChannel = xpu::thread_idx::x() * channelsPerThread < channelCount ? xpu::thread_idx::x() * channelsPerThread : channelCount;
+        const unsigned int lastChannel = firstChannel + channelsPerThread < channelCount ? firstChannel + channelsPerThread : channelCount;
+
+        // Same scan as JanSergeySortParScatter, over the group totals of the segment.
+        count_t rangeSum = 0;
+        for (unsigned int c = firstChannel; c < lastChannel; c++) {
+            for (count_t g = firstGroup; g < endGroup; g++) {
+                rangeSum += groupOffset[size_t(g) * channelCount + c];
+            }
+        }
+        smem.threadSum[0][xpu::thread_idx::x()] = rangeSum;
+        xpu::barrier();
+
+        int in = 0;
+        for (int stride = 1; stride < xpu::block_dim::x(); stride *= 2) {
+            const count_t own = smem.threadSum[in][xpu::thread_idx::x()];
+            smem.threadSum[1 - in][xpu::thread_idx::x()] = xpu::thread_idx::x() >= stride ? own + smem.threadSum[in][xpu::thread_idx::x() - stride] : own;
+            in = 1 - in;
+            xpu::barrier();
+        }
+
+        // Output positions of each group: channel by channel, each group after the earlier ones.
+        count_t offset = start + smem.threadSum[in][xpu::thread_idx::x()] - rangeSum;
+        for (unsigned int c = firstChannel; c < lastChannel; c++) {
+            for (count_t g = firstGroup; g < endGroup; g++) {
+                count_t& counter = groupOffset[size_t(g) * channelCount + c];
+                const count_t count = counter;
+                counter = offset;
+                offset += count;
+            }
+        }
+    }
+
+    struct SegmentedSortScatterSmem {
+        unsigned int tileChannel[SegmentedSortBlockDimX];
+    };
+
+    XPU_KERNEL(SegmentedSortScatter, SegmentedSortScatterSmem, const size_t n, const digi_t* digis, const index_t* chunkStart, const index_t* chunkEnd, const count_t* chunkGroup, const count_t* groupOffset, count_t* chunkOffset, digi_t* output) {
+        const index_t start = chunkStart[xpu::block_idx::x()];
+        const index_t end = chunkEnd[xpu::block_idx::x()];
+
+        // The positions of this chunk, only this block reads and advances them: its offset within the group plus the
+        // group's position.
+        count_t* channelOffset = chunkOffset + size_t(xpu::block_idx::x()) * channelCount;
+        const count_t* groupPosition = groupOffset + size_t(chunkGroup[xpu::block_idx::x()]) * channelCount;
+        for (auto c = xpu::thread_idx::x(); c < channelCount; c += xpu::block_dim::x()) {
+            channelOffset[c] += groupPosition[c];
+        }
+        xpu::barrier();
+
+        // Stable placement in tiles of blockDim digis, as in JanSergeySortParScatter.
+        for (index_t tile = start; tile <= end; tile += xpu::block_dim::x()) {
+            const index_t i = tile + xpu::thread_idx::x();
+            const bool valid = i <= end;
+            const digi_t digi = valid ? digis[i] : digi_t();
+            const unsigned int channel = valid ? digi.channel : noChannel;
+
+            smem.tileChannel[xpu::thread_idx::x()] = channel;
+            xpu::barrier();
+
+            count_t rank = 0;
+            bool last = true;
+            for (int t = 0; t < xpu::block_dim::x(); t++) {
+                if (smem.tileChannel[t] != channel) { continue; }
+                if (t < xpu::thread_idx::x()) { rank++; }
+                if (t > xpu::thread_idx::x()) { last = false; }
+            }
+
+            if (valid) {
+                output[channelOffset[channel] + rank] = digi;
+            }
+            // Every thread of the tile has read the offsets before they move on.
+            xpu::barrier();
+
+            if (valid && last) {
+                channelOffset[channel] += rank + 1;
+            }
+            xpu::barrier();
+        }
+    }
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <xpu/device.h>
+#include <cstddef>
+#include "../datastructures.h"
+#include "../constants.h"
+#include "../types.h"
+
+namespace experimental {
+
+    constexpr int SegmentedSortBlockDimX = JanSergeySortBlockDimX;
+
+    // Launched as planned by CbmStsDigiWorkPlan (workplan.h), whose packed capacity must not exceed SegmentedSortBlockDimX.
+    struct SegmentedSortKernel{};
+
+    // One block per packed block: (n, digis, smallStart, smallEnd, smallSlot, packedFirst, output).
+    XPU_EXPORT_KERNEL(SegmentedSortKernel, SegmentedSortPacked, const size_t, const digi_t*, const index_t*, const index_t*, const index_t*, const count_t*, digi_t*);
+    // One block per chunk: (n, digis, chunkStart, chunkEnd, chunkOffset), channelCount counters per chunk.
+    XPU_EXPORT_KERNEL(SegmentedSortKernel, SegmentedSortCount, const size_t, const digi_t*, const index_t*, const index_t*, count_t*);
+    // One block per group: (groupFirstChunk, chunkOffset, groupOffset), the counters become offsets within the group,
+    // channelCount group totals per group.
+    XPU_EXPORT_KERNEL(SegmentedSortKernel, SegmentedSortScanChunks, const count_t*, count_t*, count_t*);
+    // One block per segment: (segmentStart, segmentFirstGroup, groupOffset), the group totals become output positions.
+    XPU_EXPORT_KERNEL(SegmentedSortKernel, SegmentedSortScan, const index_t*, const count_t*, count_t*);
+    // One block per chunk: (n, digis, chunkStart, chunkEnd, chunkGroup, groupOffset, chunkOffset, output).
+    XPU_EXPORT_KERNEL(SegmentedSortKernel, SegmentedSortScatter, const size_t, const digi_t*, const index_t*, const index_t*, const count_t*, const count_t*, count_t*, digi_t*);
+
+}
+
+XPU_BLOCK_SIZE_1D(experimental::SegmentedSortPacked, experimental::SegmentedSortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::SegmentedSortCount, experimental::SegmentedSortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::SegmentedSortScanChunks, experimental::SegmentedSortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::SegmentedSortScan, experimental::SegmentedSortBlockDimX);
+XPU_BLOCK_SIZE_1D(experimental::SegmentedSortScatter, experimental::SegmentedSortBlockDimX);
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+// Include host functions to control the GPU.
+#include <xpu/host.h>
+
+#include "datastructures.h"
+#include "io/mapped_file.h"
+#include "io/csv.h"
+#include "io/binary.h"
+
+namespace experimental {
+
+    /// <summary>
+    /// Hands out the input in chunks of at most chunkSize digis. The input file stays mapped, already consumed
+    /// parts are released, so only one chunk (plus the parse buffers) is resident at a time.
+    /// -r and -n behave exactly as for the in-memory loaders.
+    /// </summary>
+    class digi_chunk_reader {
+        const std::string filename;
+        const unsigned int repeat;
+        size_t remaining;
+        size_t chunkSize;
+
+        std::unique_ptr<CbmStsDigiBinaryFile> binaryFile;
+        std::unique_ptr<mapped_file> csvFile;
+
+        // Position in the input: byte pointer for CSV, row index for binary files.
+        const char* csvPos = nullptr;
+        size_t binaryPos = 0;
+        // First row of the chunk handed out last, released on the next call.
+        size_t binaryChunkBegin = 0;
+
+        CbmStsDigiColumnStore store;
+
+    public:
+        digi_chunk_reader(const std::string& in_filename, const size_t in_chunk_size, const unsigned int in_repeat = 1, const size_t in_max_n = 0) : filename(in_filename), repeat(in_repeat), remaining(in_max_n != 0 ? in_max_n : SIZE_MAX) {
+            // A chunk always holds whole input rows including their repetitions.
+            chunkSize = std::max<size_t>(in_chunk_size / repeat, 1) * repeat;
+
+            if (is_binary_input(filename)) {
+                binaryFile.reset(new CbmStsDigiBinaryFile(filename));
+            } else {
+                csvFile.reset(new mapped_file(filename));
+                // Skip header
+                csvPos = csv::next_line(csvFile->begin(), csvFile->end());
+                // Parsed in place, every chunk reuses the columns.
+                store.resize(chunkSize);
+            }
+        }
+
+        digi_chunk_reader(const digi_chunk_reader&) = delete;
+        digi_chunk_reader& operator=(const digi_chunk_reader&) = delete;
+
+        size_t chunk_size() const { return chunkSize; }
+
+        // Bytes held per digi of chunk capacity by the reader itself: the parsed columns for CSV, the resident mapped
+        // rows of the chunk (and their repeated copy) for binary files.
+        static size_t bytes_per_digi(const std::string& filename, const unsigned int repeat) {
+            const size_t columns = sizeof(address_t) + sizeof(unsigned short) + sizeof(unsigned int) + sizeof(unsigned short);
+
+            if (is_binary_input(filename)) {
+                return repeat > 1 ? 2 * columns : columns;
+            }
+            return columns;
+        }
+
+        /// <summary>
+        /// Returns false once the input (or the -n cap) is exhausted. The chunk view is valid until the next call.
+        /// </summary>
+        bool next(CbmStsDigiColumns& chunk) {
+            if (remaining == 0) { return false; }
+
+            const size_t capacity = std::min(chunkSize, remaining);
+
+            if (binaryFile) {
+                // The last chunk is consumed: the mapped columns are resident only for the chunk in use.
+                binaryFile->release(binaryChunkBegin, binaryPos);
+                binaryChunkBegin = binaryPos;
+
+                const CbmStsDigiColumns all = binaryFile->columns();
+                if (binaryPos >= all.n) { return false; }
+
+                const size_t rows = std::min((capacity + repeat - 1) / repeat, all.n - binaryPos);
+                CbmStsDigiColumns slice{all.address + binaryPos, all.channel + binaryPos, all.time + binaryPos, all.charge + binaryPos, rows};
+                binaryPos += rows;
+
+                if (repeat > 1) {
+                    store = CbmStsDigiColumnStore(slice, repeat);
+                    slice = store.view();
+                }
+
+                chunk = slice.first(capacity);
+            } else {
+                const char* chunkBegin = csvPos;
+                const size_t cnt = csv::parse_rows(csvPos, csvFile->end(), store, 0, capacity, repeat, &csvPos);
+                csvFile->release(chunkBegin, csvPos);
+
+                if (cnt == 0) { return false; }
+
+                chunk = store.view().first(cnt);
+            }
+
+            remaining -= chunk.n;
+            return chunk.n > 0;
+        }
+    };
+
+    struct stream_result {
+        size_t digis = 0;
+        size_t chunks = 0;
+        size_t runs = 0;
+        float seconds = 0;
+        float sortMs = 0;
+
+        // Bucketing of the first chunk (sizes the reused storage) and of all later chunks.
+        memory_stats firstChunk;
+        memory_stats laterChunks;
+
+        float digis_per_second() const { return seconds > 0 ? digis / seconds : 0; }
+    };
+
+    /// <summary>
+    /// Streaming mode: reads the input chunk by chunk, buckets and sorts each chunk with the given
+    /// single-block-per-bucket kernel (signature of JanSergeySortSingleBlock) and emits one sorted run per
+    /// module and chunk. All buffers are sized by the memory budget, not by the input size.
+    ///
+    /// Run format in the output file: address (int32), count (uint32), followed by count sorted digis.
+    /// </summary>
+    template<typename Kernel>
+    class stream_sorter {
+        const size_t budgetBytes;
+
+    public:
+        explicit stream_sorter(const size_t in_budget_bytes) : budgetBytes(in_budget_bytes) {}
+
+        // Device input and output, each host and device side. Chunks are bucketed into the input's host half.
+        static constexpr size_t sorterBytesPerDigi = sizeof(digi_t) * 4;
+
+        stream_result run(const std::string& filename, const unsigned int repeat, const size_t max_n, const std::string& output = "") {
+            const size_t bytesPerDigi = sorterBytesPerDigi + digi_chunk_reader::bytes_per_digi(filename, repeat);
+            const size_t chunkSize = budgetBytes / bytesPerDigi;
+            if (chunkSize == 0) {
+                throw std::invalid_argument("Memory budget of " + std::to_string(budgetBytes) + " bytes is too small");
+            }
+
+            digi_chunk_reader reader(filename, chunkSize, repeat, max_n);
+            std::cout << "Streaming with chunks of " << reader.chunk_size() << " digis (" << bytesPerDigi << " bytes per digi).\n";
+
+            std::ofstream out;
+            if (output != "") {
+                out.open(output, std::ios::out | std::ios::binary | std::ios::trunc);
+                if (!out.is_open()) { throw std::runtime_error("File: " + output + " cannot be written"); }
+            }
+
+            xpu::hd_buffer<digi_t> buffDigis(reader.chunk_size());
+            xpu::hd_buffer<digi_t> buffOutput(reader.chunk_size());
+            xpu::hd_buffer<index_t> buffStartIndex;
+            xpu::hd_buffer<index_t> buffEndIndex;
+            size_t bucketCapacity = 0;
+
+            // Reused for every chunk, allocates only while chunks grow.
+            bucket_t bucket;
+
+            stream_result result;
+            const auto started = std::chrono::high_resolution_clock::now();
+
+            CbmStsDigiColumns chunk;
+            while (reader.next(chunk)) {
+                const size_t n = chunk.n;
+                bucket.reset(chunk, buffDigis.h());
+                (result.chunks == 0 ? result.firstChunk : result.laterChunks) += bucket.stats();
+
+                // Grows only if a chunk has more modules than any chunk before.
+                if (bucket.size() > bucketCapacity) {
+                    bucketCapacity = bucket.size();
+                    buffStartIndex = xpu::hd_buffer<index_t>(bucketCapacity);
+                    buffEndIndex = xpu::hd_buffer<index_t>(bucketCapacity);
+                }
+
+                std::copy(bucket.startIndex, bucket.startIndex + bucket.size(), buffStartIndex.h());
+                std::copy(bucket.endIndex, bucket.endIndex + bucket.size(), buffEndIndex.h());
+
+                xpu::copy(buffDigis.d(), buffDigis.h(), n);
+                xpu::copy(buffStartIndex.d(), buffStartIndex.h(), bucket.size());
+                xpu::copy(buffEndIndex.d(), buffEndIndex.h(), bucket.size());
+
+                xpu::run_kernel<Kernel>(xpu::grid::n_blocks(bucket.size()), n, buffDigis.d(), buffStartIndex.d(), buffEndIndex.d(), buffOutput.d());
+
+                xpu::copy(buffOutput.h(), buffOutput.d(), n);
+
+                if (out.is_open()) {
+                    for (count_t i = 0; i < bucket.size(); i++) {
+                        const address_t address = bucket.getAddress(i);
+                        const uint32_t count = bucket.end(i) - bucket.begin(i) + 1;
+                        out.write(reinterpret_cast<const char*>(&address), sizeof(address));
+                        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+                        out.write(reinterpret_cast<const char*>(buffOutput.h() + bucket.begin(i)), count * sizeof(digi_t));
+                    }
+                }
+
+                result.digis += n;
+                result.chunks++;
+                result.runs += bucket.size();
+            }
+
+            const auto done = std::chrono::high_resolution_clock::now();
+            result.seconds = std::chrono::duration<float>(done - started).count();
+
+            for (const float ms : xpu::get_timing<Kernel>()) {
+                result.sortMs += ms;
+            }
+
+            return result;
+        }
+    };
+
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include "../common.h"
+#include "../io/binary.h"
+#include "../io/archive.h"
+
+// Converts a digi CSV dump into the binary columnar format (see io/binary.h),
+// which stsdigisort maps directly instead of parsing it on every run.
+// With -z the output is a compressed archive (see io/archive.h) instead.
+int main(int argc, char** argv) {
+    try {
+        std::string input;
+        std::string output;
+        bool compress = false;
+
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "-i") == 0) {
+                input = argv[i + 1];
+            } else if (strcmp(argv[i], "-o") == 0) {
+                output = argv[i + 1];
+            } else if (strcmp(argv[i], "-z") == 0) {
+                compress = true;
+            }
+        }
+
+        if (input == "") throw std::invalid_argument("Usage: csv2bin -i <digis.csv> [-o <digis.bin|digis.dza>] [-z]");
+        if (output == "") output = input.substr(0, input.find_last_of('.')) + (compress ? ".dza" : ".bin");
+
+        const auto started = std::chrono::high_resolution_clock::now();
+
+        const experimental::CbmStsDigiColumnStore columns = experimental::readCsv(input);
+        const size_t n = columns.size();
+
+        if (compress) {
+            const bucket_t bucket(columns.view());
+            experimental::writeArchive(output, bucket);
+        } else {
+            experimental::writeBinary(output, columns.view());
+        }
+
+        const auto done = std::chrono::high_resolution_clock::now();
+        std::cout << "Wrote " << n << " digis to " << output << " in " << std::chrono::duration<float, std::milli>(done - started).count() << "ms\n";
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include "../common.h"
+#include "../io/ingest.h"
+#include "../generator.h"
+
+// Synthesizes large timeslices in the binary columnar format (see io/binary.h).
+// The distributions are learned from a real input (CSV or binary); -p selects an adversarial profile.
+int main(int argc, char** argv) {
+    try {
+        std::vector<std::string> inputs;
+        std::string output;
+        size_t n = 0;
+        std::string profile = "realistic";
+        double hotFraction = 0.9;
+        size_t moduleCount = 10000;
+        uint64_t seed = 42;
+        unsigned int threads = experimental::default_thread_count();
+
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "-i") == 0) {
+                inputs.push_back(argv[i + 1]);
+            } else if (strcmp(argv[i], "-o") == 0) {
+                output = argv[i + 1];
+            } else if (strcmp(argv[i], "-n") == 0) {
+                n = std::stoull(argv[i + 1]);
+            } else if (strcmp(argv[i], "-p") == 0) {
+                profile = argv[i + 1];
+            } else if (strcmp(argv[i], "-f") == 0) {
+                // Share of the digis on the hot module (hot-module profile).
+                hotFraction = std::stod(argv[i + 1]);
+            } else if (strcmp(argv[i], "-a") == 0) {
+                // Number of modules (tiny-modules profile).
+                moduleCount = std::stoull(argv[i + 1]);
+            } else if (strcmp(argv[i], "-s") == 0) {
+                seed = std::stoull(argv[i + 1]);
+            } else if (strcmp(argv[i], "-j") == 0) {
+                threads = std::stoul(argv[i + 1]);
+            }
+        }
+
+        if (inputs.empty() || output == "") {
+            throw std::invalid_argument("Usage: digigen -i <digis.csv|digis.bin> -o <out.bin> [-n digis] [-p realistic|hot-module|one-channel|uniform|tiny-modules] [-f hot fraction] [-a modules] [-s seed] [-j threads]");
+        }
+        if (!experimental::is_binary_input(output)) throw std::invalid_argument("Output must be a .bin file");
+
+        const auto started = std::chrono::high_resolution_clock::now();
+
+        const experimental::CbmStsDigiColumnStore digis = experimental::readDigis(experimental::expand_inputs(inputs), 1, 0, threads);
+        experimental::digi_model model = experimental::learn_model(digis.view());
+        experimental::apply_profile(model, experimental::parse_profile(profile), hotFraction, moduleCount);
+
+        if (n == 0) n = digis.size();
+
+        std::cout << "Learned " << digis.size() << " digis, generating " << n << " digis on " << model.size() << " modules (" << profile << ")\n";
+        experimental::generateBinary(output, model, n, seed, threads);
+
+        const auto done = std::chrono::high_resolution_clock::now();
+        std::cout << "Wrote " << n << " digis to " << output << " in " << std::chrono::duration<float, std::milli>(done - started).count() << "ms\n";
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+#include "datastructures.h"
+#include "constants.h"
+#include "types.h"
+
+namespace experimental {
+
+    /// <summary>
+    /// Launch plan of the SegmentedSort kernels, computed from the bucket layout (startIndex, endIndex) only.
+    /// The blocks get about the same work whatever the bucket sizes:
+    ///
+    /// Small buckets (at most packedCapacity digis) are packed into blocks of up to packedCapacity digis, consecutive
+    /// buckets first. Every other bucket is a segment, cut into chunks of chunkSize digis (the last one shorter),
+    /// one block per chunk in the count and scatter kernels. The scan is two-level: one block per group of up to
+    /// groupSize consecutive chunks of a segment, then one block per segment over its groups. A segment of m chunks
+    /// is scanned over m / groupSize rows of group totals instead of m rows of chunk counters.
+    ///
+    /// All vectors are ready to be copied to the device as they are.
+    /// </summary>
+    class CbmStsDigiWorkPlan {
+
+    public:
+        // Digis per packed block, one per thread.
+        const index_t packedCapacity;
+        // Digis per chunk of a segment.
+        const index_t chunkSize;
+        // Chunks per group in the scan.
+        const count_t groupSize;
+
+        // Small buckets: start, end (inclusive), and position of their first digi within their packed block.
+        std::vector<index_t> smallStart;
+        std::vector<index_t> smallEnd;
+        std::vector<index_t> smallSlot;
+        // First small bucket of each packed block, plus the end: blocks() + 1 entries.
+        std::vector<count_t> packedFirst;
+
+        // Chunks of all segments, in segment order: start, end (inclusive), group.
+        std::vector<index_t> chunkStart;
+        std::vector<index_t> chunkEnd;
+        std::vector<count_t> chunkGroup;
+
+        // First chunk of each group, plus the end: groups() + 1 entries.
+        std::vector<count_t> groupFirstChunk;
+
+        // Segments: start of the bucket, first group, plus the end: segments() + 1 entries.
+        std::vector<index_t> segmentStart;
+        std::vector<count_t> segmentFirstGroup;
+
+        CbmStsDigiWorkPlan(const index_t in_packed_capacity = JanSergeySortBlockDimX, const index_t in_chunk_size = 4096, const count_t in_group_size = 32)
+            : packedCapacity(in_packed_capacity), chunkSize(in_chunk_size), groupSize(in_group_size) {
+            if (packedCapacity == 0 || chunkSize == 0 || groupSize == 0) {
+                throw std::invalid_argument("CbmStsDigiWorkPlan: packed capacity, chunk size and group size must be positive");
+            }
+        }
+
+        /// <summary>
+        /// Running time: O(buckets + chunks).
+        /// </summary>
+        void plan(const index_t* startIndex, const index_t* endIndex, const count_t buckets) {
+            smallStart.clear();
+            smallEnd.clear();
+            smallSlot.clear();
+            packedFirst.clear();
+            chunkStart.clear();
+            chunkEnd.clear();
+            chunkGroup.clear();
+            groupFirstChunk.clear();
+            segmentStart.clear();
+            segmentFirstGroup.clear();
+
+            // Digis in the packed block being filled.
+            index_t filled = 0;
+
+            for (count_t b = 0; b < buckets; b++) {
+                const index_t start = startIndex[b];
+                const index_t size = endIndex[b] + 1 - start;
+
+                if (size <= packedCapacity) {
+                    // Also at most packedCapacity buckets per block, for empty buckets.
+                    if (packedFirst.empty() || filled + size > packedCapacity || smallStart.size() - packedFirst.back() >= packedCapacity) {
+                        packedFirst.push_back(static_cast<count_t>(smallStart.size()));
+                        filled = 0;
+                    }
+                    smallStart.push_back(start);
+                    smallEnd.push_back(endIndex[b]);
+                    smallSlot.push_back(filled);
+                    filled += size;
+                    continue;
+                }
+
+                segmentStart.push_back(start);
+                segmentFirstGroup.push_back(static_cast<count_t>(groupFirstChunk.size()));
+                count_t chunkInSegment = 0;
+                for (index_t c = start; c <= endIndex[b]; c += chunkSize, chunkInSegment++) {
+                    // Groups do not span segments.
+                    if (chunkInSegment % groupSize == 0) { groupFirstChunk.push_back(chunks()); }
+                    chunkStart.push_back(c);
+                    chunkEnd.push_back(c + chunkSize - 1 < endIndex[b] ? c + chunkSize - 1 : endIndex[b]);
+                    chunkGroup.push_back(static_cast<count_t>(groupFirstChunk.size() - 1));
+                }
+            }
+
+            packedFirst.push_back(static_cast<count_t>(smallStart.size()));
+            segmentFirstGroup.push_back(static_cast<count_t>(groupFirstChunk.size()));
+            groupFirstChunk.push_back(chunks());
+        }
+
+        void plan(const bucket_t& bucket) { plan(bucket.startIndex, bucket.endIndex, bucket.size()); }
+
+        count_t blocks() const { return static_cast<count_t>(packedFirst.size() - 1); }
+
+        count_t chunks() const { return static_cast<count_t>(chunkStart.size()); }
+
+        count_t segments() const { return static_cast<count_t>(segmentStart.size()); }
+
+        count_t groups() const { return static_cast<count_t>(groupFirstChunk.size() - 1); }
+
+    };
+
+}